@@ -0,0 +1,423 @@
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Compiler.h"
+#include "Corpus.h"
+#include "Parser.h"
+#include "TreeWalker.h"
+#include "VM.h"
+
+// Throughput of the lexer alone and of lexer + parser over generated
+// programs, and of the bytecode VM against a naive tree walker over a few
+// fixed programs. Every case runs in a forked child, so peak RSS is that
+// case's own high-water mark rather than the largest seen so far. Results go
+// to stdout as JSON, progress to stderr.
+
+namespace {
+  std::atomic<uint64_t> allocations = 0;
+  std::atomic<uint64_t> allocatedBytes = 0;
+} // namespace
+
+// Every allocation in this binary is counted. The array and sized forms
+// forward to these by default.
+void *operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  if (void *p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  std::free(p);
+}
+
+enum class Phase {
+  LEX,
+  PARSE,
+  WALK,
+  VM,
+};
+
+static constexpr std::string_view PHASE_NAMES[] = { "lex", "parse", "walk", "vm" };
+
+static std::string_view phaseName(Phase phase) {
+  return PHASE_NAMES[static_cast<size_t>(phase)];
+}
+
+static bool executes(Phase phase) {
+  return phase == Phase::WALK || phase == Phase::VM;
+}
+
+struct BenchProgram {
+  std::string_view name;
+  std::string_view source;
+};
+
+// Call-heavy programs whose run time is dominated by evaluation rather than
+// by parsing them.
+static constexpr BenchProgram PROGRAMS[] = {
+  { "fib", R"(define fib(n as int) as int begin
+  if n < 2 then
+    n
+  end else fib(n - 1) + fib(n - 2)
+end
+fib(27)
+)" },
+  { "sum", R"(define sum(lo as int, hi as int) as float begin
+  if hi - lo < 2 then
+    1.0 / (lo * lo + 1)
+  end else begin
+    let mid as int = (lo + hi) / 2
+    sum(lo, mid) + sum(mid, hi)
+  end
+end
+sum(0, 100000)
+)" },
+  { "collatz", R"(define steps(n as int, k as int) as int begin
+  if n == 1 then
+    k
+  end else if n % 2 == 0 then
+    steps(n / 2, k + 1)
+  end else steps(3 * n + 1, k + 1)
+end
+define total(lo as int, hi as int) as int begin
+  if hi - lo < 2 then
+    steps(lo, 0)
+  end else begin
+    let mid as int = (lo + hi) / 2
+    total(lo, mid) + total(mid, hi)
+  end
+end
+total(1, 10000)
+)" },
+};
+
+// Written by the child into a pipe, so plain data only.
+struct Measurement {
+  bool ok;
+  double seconds; // fastest iteration
+  uint64_t tokens;
+  uint64_t nodes;
+  uint64_t allocations; // per iteration
+  uint64_t allocatedBytes;
+  uint64_t peakRss;
+  char result[32]; // what a walk or vm run evaluated to
+};
+
+struct Options {
+  uint64_t seed = 1;
+  size_t size = 4 << 20;
+  unsigned iterations = 5;
+  std::vector<CorpusShape> shapes;
+  std::vector<Phase> phases;
+};
+
+static uint64_t lex(const std::string &corpus) {
+  SymbolTable symbols;
+  Lexer lexer(std::string_view(corpus), symbols);
+  TokenBuffer tokens;
+  lexer.tokenize(tokens);
+  return tokens.size();
+}
+
+// A corpus or program with syntax errors would time error recovery rather
+// than parsing, so the case fails on the first one.
+static void throwFirstError(const Parser &parser, const std::string &source) {
+  if (!parser.diagnostics().empty()) {
+    throw std::runtime_error(Diagnostics::format(parser.diagnostics()[0], SourceMap(source)));
+  }
+}
+
+static uint64_t parse(const std::string &corpus) {
+  SymbolTable symbols;
+  Lexer lexer(std::string_view(corpus), symbols);
+  Parser parser(lexer, TokenMode::PRELEXED);
+  AST ast = parser();
+  throwFirstError(parser, corpus);
+  return ast.size();
+}
+
+static Measurement measure(const std::string &corpus, Phase phase, unsigned iterations) {
+  Measurement m{};
+  m.tokens = lex(corpus);
+  m.seconds = 1e300;
+
+  // Programs are parsed and compiled once, outside the timed runs. `print`
+  // output is discarded.
+  SymbolTable symbols;
+  AST ast;
+  Program program;
+  std::ostringstream out;
+  std::string result;
+  if (executes(phase)) {
+    Lexer lexer(std::string_view(corpus), symbols);
+    Parser parser(lexer);
+    ast = parser();
+    throwFirstError(parser, corpus);
+    m.nodes = ast.size();
+    Semantics semantics = Resolver(ast, symbols)();
+    program = Compiler(ast, symbols, semantics)();
+  }
+  VM vm(program, out);
+
+  for (unsigned i = 0; i < iterations; i++) {
+    uint64_t count = allocations.load(std::memory_order_relaxed);
+    uint64_t bytes = allocatedBytes.load(std::memory_order_relaxed);
+    auto start = std::chrono::steady_clock::now();
+    uint64_t n = 0;
+    std::ostringstream value;
+    switch (phase) {
+    case Phase::LEX:
+      n = lex(corpus);
+      break;
+    case Phase::PARSE:
+      n = parse(corpus);
+      break;
+    case Phase::WALK:
+      value << TreeWalker(ast, symbols, out).run();
+      break;
+    case Phase::VM:
+      printValue(value, program, vm.run(), program.functions[program.main].result);
+      break;
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    out.str({});
+    result = value.str();
+
+    m.seconds = std::min(m.seconds, elapsed.count());
+    m.allocations = allocations.load(std::memory_order_relaxed) - count;
+    m.allocatedBytes = allocatedBytes.load(std::memory_order_relaxed) - bytes;
+    if (phase == Phase::PARSE) {
+      m.nodes = n;
+    }
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  m.peakRss = static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+  result.copy(m.result, sizeof(m.result) - 1);
+  m.ok = true;
+  return m;
+}
+
+static Measurement measureInChild(const std::string &corpus, Phase phase, unsigned iterations) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    throw std::runtime_error("pipe: " + std::string(std::strerror(errno)));
+  }
+  pid_t pid = fork();
+  if (pid < 0) {
+    throw std::runtime_error("fork: " + std::string(std::strerror(errno)));
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    Measurement m{};
+    try {
+      m = measure(corpus, phase, iterations);
+    } catch (const std::exception &e) {
+      std::cerr << "  " << e.what() << std::endl;
+    }
+    ssize_t written = write(fds[1], &m, sizeof(m));
+    _exit(written == sizeof(m) ? 0 : 1);
+  }
+
+  close(fds[1]);
+  Measurement m{};
+  ssize_t got = read(fds[0], &m, sizeof(m));
+  close(fds[0]);
+  int status = 0;
+  waitpid(pid, &status, 0);
+  if (got != sizeof(m) || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    m.ok = false;
+  }
+  return m;
+}
+
+// The whole of `text` as a number; false for anything else, sign included.
+template <typename T>
+static bool parseNumber(std::string_view text, T &value) {
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc() && end == text.data() + text.size();
+}
+
+static void usage(std::ostream &os) {
+  os << "usage: skwirl-bench [--seed N] [--size BYTES] [--iterations N] [--shape NAME]... [--phase lex|parse|walk|vm]...\n"
+     << "       skwirl-bench --emit NAME [--seed N] [--size BYTES]\n"
+     << "shapes:";
+  for (CorpusShape shape : corpus::SHAPES) {
+    os << ' ' << corpusShapeName(shape);
+  }
+  os << "\nprograms:";
+  for (const BenchProgram &program : PROGRAMS) {
+    os << ' ' << program.name;
+  }
+  os << std::endl;
+}
+
+int main(int argc, char **argv) {
+  Options options;
+  bool emit = false;
+
+  for (int i = 1; i < argc; i++) {
+    bool more = i + 1 < argc;
+    if (std::strcmp(argv[i], "--seed") == 0 && more) {
+      if (!parseNumber(argv[++i], options.seed)) {
+        std::cerr << "--seed takes a number" << std::endl;
+        usage(std::cerr);
+        return 2;
+      }
+    } else if (std::strcmp(argv[i], "--size") == 0 && more) {
+      if (!parseNumber(argv[++i], options.size)) {
+        std::cerr << "--size takes a number of bytes" << std::endl;
+        usage(std::cerr);
+        return 2;
+      }
+    } else if (std::strcmp(argv[i], "--iterations") == 0 && more) {
+      if (!parseNumber(argv[++i], options.iterations)) {
+        std::cerr << "--iterations takes a number" << std::endl;
+        usage(std::cerr);
+        return 2;
+      }
+      options.iterations = std::max(1u, options.iterations);
+    } else if ((std::strcmp(argv[i], "--shape") == 0 || std::strcmp(argv[i], "--emit") == 0) && more) {
+      emit = emit || argv[i][2] == 'e';
+      CorpusShape shape;
+      if (!findCorpusShape(argv[++i], shape)) {
+        std::cerr << "unknown shape '" << argv[i] << "'" << std::endl;
+        usage(std::cerr);
+        return 2;
+      }
+      options.shapes.push_back(shape);
+    } else if (std::strcmp(argv[i], "--phase") == 0 && more) {
+      std::string_view name = argv[++i];
+      auto found = std::find(std::begin(PHASE_NAMES), std::end(PHASE_NAMES), name);
+      if (found == std::end(PHASE_NAMES)) {
+        usage(std::cerr);
+        return 2;
+      }
+      options.phases.push_back(static_cast<Phase>(found - std::begin(PHASE_NAMES)));
+    } else {
+      usage(std::cerr);
+      return 2;
+    }
+  }
+  if (options.shapes.empty()) {
+    options.shapes.assign(std::begin(corpus::SHAPES), std::end(corpus::SHAPES));
+  }
+  if (options.phases.empty()) {
+    options.phases = { Phase::LEX, Phase::PARSE, Phase::WALK, Phase::VM };
+  }
+
+  if (emit) {
+    for (CorpusShape shape : options.shapes) {
+      std::cout << CorpusGenerator(options.seed).generate(shape, options.size);
+    }
+    return 0;
+  }
+
+  int status = 0;
+  std::cout << "{\n"
+            << "  \"compiler\": \"" << __VERSION__ << "\",\n"
+            << "  \"seed\": " << options.seed << ",\n"
+            << "  \"size\": " << options.size << ",\n"
+            << "  \"iterations\": " << options.iterations << ",\n"
+            << "  \"results\": [";
+  const char *separator = "\n";
+  bool parsing = std::any_of(options.phases.begin(), options.phases.end(), [](Phase phase) { return !executes(phase); });
+  for (CorpusShape shape : options.shapes) {
+    if (!parsing) {
+      break;
+    }
+    std::string corpus = CorpusGenerator(options.seed).generate(shape, options.size);
+    for (Phase phase : options.phases) {
+      if (executes(phase)) {
+        continue;
+      }
+      std::cerr << corpusShapeName(shape) << '/' << phaseName(phase) << std::endl;
+      Measurement m = measureInChild(corpus, phase, options.iterations);
+      if (!m.ok) {
+        std::cerr << "  failed" << std::endl;
+        status = 1;
+      }
+      std::cout << separator
+                << "    {\"shape\": \"" << corpusShapeName(shape) << "\", \"phase\": \"" << phaseName(phase) << "\""
+                << ", \"ok\": " << (m.ok ? "true" : "false")
+                << ", \"bytes\": " << corpus.size()
+                << ", \"tokens\": " << m.tokens
+                << ", \"nodes\": " << m.nodes
+                << ", \"seconds\": " << m.seconds
+                << ", \"bytes_per_sec\": " << (m.ok ? corpus.size() / m.seconds : 0)
+                << ", \"tokens_per_sec\": " << (m.ok ? m.tokens / m.seconds : 0)
+                << ", \"nodes_per_sec\": " << (m.ok ? m.nodes / m.seconds : 0)
+                << ", \"peak_rss_bytes\": " << m.peakRss
+                << ", \"allocations\": " << m.allocations
+                << ", \"allocated_bytes\": " << m.allocatedBytes
+                << "}";
+      separator = ",\n";
+    }
+  }
+
+  // The walker's time for the same program is the baseline for the VM's.
+  for (const BenchProgram &program : PROGRAMS) {
+    std::string source(program.source);
+    double baseline = 0;
+    std::string expected;
+    for (Phase phase : options.phases) {
+      if (!executes(phase)) {
+        continue;
+      }
+      std::cerr << program.name << '/' << phaseName(phase) << std::endl;
+      Measurement m = measureInChild(source, phase, options.iterations);
+      if (m.ok && phase == Phase::WALK) {
+        baseline = m.seconds;
+        expected = m.result;
+      }
+      if (m.ok && phase == Phase::VM && !expected.empty() && expected != m.result) {
+        std::cerr << "  result " << m.result << " differs from the walker's " << expected << std::endl;
+        m.ok = false;
+      }
+      if (!m.ok) {
+        std::cerr << "  failed" << std::endl;
+        status = 1;
+      }
+      std::cout << separator
+                << "    {\"program\": \"" << program.name << "\", \"phase\": \"" << phaseName(phase) << "\""
+                << ", \"ok\": " << (m.ok ? "true" : "false")
+                << ", \"result\": \"" << m.result << "\""
+                << ", \"nodes\": " << m.nodes
+                << ", \"seconds\": " << m.seconds
+                << ", \"speedup\": " << (m.ok && baseline > 0 ? baseline / m.seconds : 0)
+                << ", \"peak_rss_bytes\": " << m.peakRss
+                << ", \"allocations\": " << m.allocations
+                << ", \"allocated_bytes\": " << m.allocatedBytes
+                << "}";
+      separator = ",\n";
+    }
+  }
+  std::cout << "\n  ]\n}" << std::endl;
+
+  return status;
+}
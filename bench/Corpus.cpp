@@ -0,0 +1,272 @@
+#include "Corpus.h"
+
+#include <iterator>
+#include <utility>
+#include <vector>
+
+#include "Operator.h"
+
+std::string_view corpusShapeName(CorpusShape shape) {
+  switch (shape) {
+  case CorpusShape::NESTED: return "nested";
+  case CorpusShape::BEGIN: return "begin";
+  case CorpusShape::DEFINES: return "defines";
+  case CorpusShape::STRINGS: return "strings";
+  case CorpusShape::OPERATORS: return "operators";
+  case CorpusShape::MIXED: return "mixed";
+  }
+  return "?";
+}
+
+bool findCorpusShape(std::string_view name, CorpusShape &shape) {
+  for (CorpusShape s : corpus::SHAPES) {
+    if (corpusShapeName(s) == name) {
+      shape = s;
+      return true;
+    }
+  }
+  return false;
+}
+
+std::string CorpusGenerator::generate(CorpusShape shape, size_t bytes) {
+  m_out.clear();
+  m_out.reserve(bytes + 4096);
+  while (m_out.size() < bytes) {
+    statement(shape);
+    m_statements++;
+  }
+  return std::move(m_out);
+}
+
+uint64_t CorpusGenerator::below(uint64_t n) {
+  // The slight modulo bias is irrelevant here; staying reproducible is not.
+  return m_random() % n;
+}
+
+void CorpusGenerator::statement(CorpusShape shape) {
+  if (shape == CorpusShape::MIXED) {
+    shape = corpus::SHAPES[below(std::size(corpus::SHAPES) - 1)];
+    if (chance(20)) {
+      name();
+      m_out += " = ";
+      expression(3);
+      m_out += '\n';
+      return;
+    }
+  }
+
+  std::string let = "let v" + std::to_string(m_statements) + " as ";
+  switch (shape) {
+  case CorpusShape::NESTED:
+    m_out += let + "int = ";
+    nested(32 + below(192));
+    break;
+  case CorpusShape::BEGIN:
+    m_out += let + "int = ";
+    block(200 + below(800));
+    break;
+  case CorpusShape::DEFINES:
+    define();
+    break;
+  case CorpusShape::STRINGS:
+    if (chance(50)) {
+      m_out += let + "string = ";
+      string();
+      for (uint64_t n = below(4); n > 0; n--) {
+        m_out += " + ";
+        string();
+      }
+    } else {
+      m_out += "print(";
+      string();
+      m_out += chance(50) ? ", '\\n', " : ", 'c', ";
+      string();
+      m_out += ')';
+    }
+    break;
+  case CorpusShape::OPERATORS:
+    m_out += let + "int = ";
+    operators(8 + below(56));
+    break;
+  case CorpusShape::MIXED:
+    break;
+  }
+  m_out += '\n';
+}
+
+void CorpusGenerator::nested(uint32_t depth) {
+  if (depth == 0) {
+    atom();
+    return;
+  }
+  switch (below(5)) {
+  case 0:
+    m_out += '(';
+    nested(depth - 1);
+    m_out += ')';
+    break;
+  case 1:
+    m_out += "begin\n";
+    nested(depth - 1);
+    m_out += "\nend";
+    break;
+  case 2:
+    m_out += "if ";
+    name();
+    m_out += " then\n";
+    nested(depth - 1);
+    m_out += "\nend else ";
+    atom();
+    break;
+  case 3:
+    m_out += "f(";
+    atom();
+    m_out += ", ";
+    nested(depth - 1);
+    m_out += ')';
+    break;
+  default:
+    m_out += '!';
+    nested(depth - 1);
+    break;
+  }
+}
+
+void CorpusGenerator::block(uint32_t statements) {
+  m_out += "begin\n";
+  for (uint32_t i = 0; i < statements; i++) {
+    m_out += "  ";
+    expression(1);
+    m_out += '\n';
+  }
+  m_out += "end";
+}
+
+void CorpusGenerator::define() {
+  m_out += "define fn" + std::to_string(m_statements) + "(a as int, b as float) as int ";
+  block(2 + below(7));
+}
+
+void CorpusGenerator::expression(uint32_t depth) {
+  if (depth == 0 || chance(40)) {
+    operators(1 + below(4));
+    return;
+  }
+  switch (below(3)) {
+  case 0:
+    m_out += "if ";
+    expression(depth - 1);
+    m_out += " then\n  ";
+    expression(depth - 1);
+    m_out += "\nend else ";
+    expression(depth - 1);
+    break;
+  case 1:
+    m_out += '(';
+    expression(depth - 1);
+    m_out += ") * ";
+    atom();
+    break;
+  default:
+    m_out += "g(";
+    expression(depth - 1);
+    m_out += ", ";
+    expression(depth - 1);
+    m_out += ')';
+    break;
+  }
+}
+
+void CorpusGenerator::operators(uint32_t terms) {
+  // Drawn from the operator table, so new operators show up here as soon as
+  // the lexer knows them. Assignment is left to whole statements.
+  static const auto [binary, prefix] = [] {
+    std::pair<std::vector<std::string_view>, std::vector<std::string_view>> ops;
+    for (size_t i = 1; i < op::COUNT; i++) {
+      if (static_cast<Operator>(i) == Operator::ASSIGN) {
+        continue;
+      }
+      if (op::TABLE[i].binary != 0) {
+        ops.first.push_back(op::TABLE[i].name);
+      }
+      if (op::TABLE[i].prefix != 0) {
+        ops.second.push_back(op::TABLE[i].name);
+      }
+    }
+    return ops;
+  }();
+
+  for (uint32_t i = 0; i < terms; i++) {
+    if (i > 0) {
+      m_out += ' ';
+      m_out += binary[below(binary.size())];
+      m_out += ' ';
+    }
+    if (chance(15)) {
+      m_out += prefix[below(prefix.size())];
+    }
+    if (terms > 2 && chance(10)) {
+      m_out += '(';
+      operators(2 + below(3));
+      m_out += ')';
+    } else {
+      atom();
+    }
+  }
+}
+
+void CorpusGenerator::atom() {
+  switch (below(8)) {
+  case 0:
+  case 1:
+    name();
+    break;
+  case 2:
+    m_out += std::to_string(below(100000));
+    break;
+  case 3:
+    m_out += std::to_string(below(1000)) + '.' + std::to_string(below(100));
+    break;
+  case 4:
+    string();
+    break;
+  case 5:
+    m_out += chance(50) ? "'c'" : "'\\t'";
+    break;
+  case 6:
+    m_out += chance(50) ? "true" : "false";
+    break;
+  default:
+    m_out += "f(";
+    name();
+    m_out += ", ";
+    m_out += std::to_string(below(10));
+    m_out += ')';
+    break;
+  }
+}
+
+void CorpusGenerator::name() {
+  if (m_statements == 0 || chance(30)) {
+    m_out += chance(50) ? "x" : "y1";
+  } else {
+    m_out += 'v';
+    m_out += std::to_string(below(m_statements));
+  }
+}
+
+void CorpusGenerator::string() {
+  static constexpr std::string_view TEXT = "abcdefghijklmnopqrstuvwxyz ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789.,;:!?-+*/()[]{}<>=";
+  static constexpr std::string_view ESCAPES = "ntr\\\"'0";
+
+  m_out += '"';
+  for (uint64_t n = 4 + below(60); n > 0; n--) {
+    if (chance(3)) {
+      m_out += '\\';
+      m_out += ESCAPES[below(ESCAPES.size())];
+    } else {
+      m_out += TEXT[below(TEXT.size())];
+    }
+  }
+  m_out += '"';
+}
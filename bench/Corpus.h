@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <string_view>
+
+enum class CorpusShape {
+  NESTED,    // deeply nested groups, blocks, ifs and calls
+  BEGIN,     // long `begin ... end` bodies
+  DEFINES,   // many small `define`s
+  STRINGS,   // string and char literals, some with escapes
+  OPERATORS, // long binary and unary operator chains
+  MIXED,     // a bit of everything, statement by statement
+};
+
+namespace corpus {
+  inline constexpr CorpusShape SHAPES[] = {
+    CorpusShape::NESTED,
+    CorpusShape::BEGIN,
+    CorpusShape::DEFINES,
+    CorpusShape::STRINGS,
+    CorpusShape::OPERATORS,
+    CorpusShape::MIXED,
+  };
+} // namespace corpus
+
+std::string_view corpusShapeName(CorpusShape shape);
+bool findCorpusShape(std::string_view name, CorpusShape &shape);
+
+// Writes syntactically valid programs of a given shape. The output depends
+// only on the seed: mt19937_64's sequence is fixed by the standard, and the
+// generator draws from it directly rather than through the library's
+// distributions, whose results differ between implementations.
+class CorpusGenerator {
+private:
+  std::mt19937_64 m_random;
+  std::string m_out;
+  uint32_t m_statements = 0;
+
+public:
+  explicit CorpusGenerator(uint64_t seed) : m_random(seed) { }
+
+  // Whole statements are appended until the program is at least `bytes`
+  // long.
+  std::string generate(CorpusShape shape, size_t bytes);
+
+private:
+  uint64_t below(uint64_t n);
+  inline bool chance(uint64_t percent) {
+    return below(100) < percent;
+  }
+
+  void statement(CorpusShape shape);
+  void nested(uint32_t depth);
+  void block(uint32_t statements);
+  void define();
+  void expression(uint32_t depth);
+  void operators(uint32_t terms);
+  void atom();
+  void name();
+  void string();
+};
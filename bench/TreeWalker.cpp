@@ -0,0 +1,255 @@
+#include "TreeWalker.h"
+
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+static bool isReal(const TreeWalker::Value &value) {
+  return std::holds_alternative<double>(value);
+}
+
+static int64_t asInt(const TreeWalker::Value &value) {
+  if (auto i = std::get_if<int64_t>(&value)) {
+    return *i;
+  }
+  if (auto b = std::get_if<bool>(&value)) {
+    return *b;
+  }
+  if (auto c = std::get_if<char>(&value)) {
+    return static_cast<unsigned char>(*c);
+  }
+  if (auto f = std::get_if<double>(&value)) {
+    return static_cast<int64_t>(*f);
+  }
+  return !std::get<std::string>(value).empty();
+}
+
+static double asReal(const TreeWalker::Value &value) {
+  return isReal(value) ? std::get<double>(value) : static_cast<double>(asInt(value));
+}
+
+static bool truthy(const TreeWalker::Value &value) {
+  return isReal(value) ? std::get<double>(value) != 0.0 : asInt(value) != 0;
+}
+
+TreeWalker::TreeWalker(const AST &ast, const SymbolTable &symbols, std::ostream &out)
+  : m_ast(ast), m_symbols(symbols), m_out(out) { }
+
+TreeWalker::Value TreeWalker::run() {
+  auto body = std::get<AST::Array>(m_ast.ref().at(astid::PROG));
+  for (const ASTRef &statement : body) {
+    if (statement == ASTType::FUNCTION) {
+      m_functions[std::get<Symbol>(statement.at(astid::FUNCTION_NAME)).id] = statement;
+    }
+  }
+
+  Value result = int64_t(0);
+  for (const ASTRef &statement : body) {
+    if (statement == ASTType::FUNCTION) {
+      continue;
+    }
+    result = eval(statement);
+  }
+  return result;
+}
+
+TreeWalker::Value TreeWalker::eval(ASTRef node) {
+  switch (node.type()) {
+  case ASTType::NAME:
+    return lookup(std::get<Symbol>(node.at(astid::VALUE)));
+  case ASTType::INTEGER:
+    return std::get<int64_t>(node.at(astid::VALUE));
+  case ASTType::FLOAT:
+    return std::get<double>(node.at(astid::VALUE));
+  case ASTType::BOOL:
+    return std::get<bool>(node.at(astid::VALUE));
+  case ASTType::CHAR:
+    return std::get<char>(node.at(astid::VALUE));
+  case ASTType::STRING:
+    return std::string(std::get<std::string_view>(node.at(astid::VALUE)));
+  case ASTType::PROG: {
+    Value result = int64_t(0);
+    auto body = std::get<AST::Array>(node.at(astid::PROG));
+    m_scopes.emplace_back();
+    for (const ASTRef &statement : body) {
+      result = eval(statement);
+    }
+    m_scopes.pop_back();
+    return result;
+  }
+  case ASTType::VAR: {
+    Value value = int64_t(0);
+    auto init = node.at(astid::VAR_INITVAL);
+    if (auto p = std::get_if<ASTRef>(&init)) {
+      value = eval(*p);
+    }
+    value = convert(value, std::get<Symbol>(node.at(astid::VAR_TYPE)));
+    Scope &scope = m_scopes.empty() ? m_globals : m_scopes.back();
+    scope[std::get<Symbol>(node.at(astid::VAR_NAME)).id] = value;
+    return value;
+  }
+  case ASTType::ASSIGN: {
+    ASTRef target = std::get<ASTRef>(node.at(astid::BINARY_LEFT));
+    Value value = eval(std::get<ASTRef>(node.at(astid::BINARY_RIGHT)));
+    Value &slot = lookup(std::get<Symbol>(target.at(astid::VALUE)));
+    if (isReal(slot) && !isReal(value)) {
+      value = asReal(value);
+    }
+    slot = value;
+    return value;
+  }
+  case ASTType::BINARY:
+    return binary(node);
+  case ASTType::UNARY: {
+    auto op = std::get<std::string_view>(node.at(astid::UNARY_OP));
+    Value value = eval(std::get<ASTRef>(node.at(astid::UNARY_OPERAND)));
+    if (op == "!") {
+      return !truthy(value);
+    }
+    if (op == "-") {
+      return isReal(value) ? Value(-std::get<double>(value)) : Value(-asInt(value));
+    }
+    return value;
+  }
+  case ASTType::IF: {
+    if (truthy(eval(std::get<ASTRef>(node.at(astid::IF_COND))))) {
+      return eval(std::get<ASTRef>(node.at(astid::IF_THEN)));
+    }
+    auto otherwise = node.at(astid::IF_ELSE);
+    if (auto p = std::get_if<ASTRef>(&otherwise)) {
+      return eval(*p);
+    }
+    return int64_t(0);
+  }
+  case ASTType::CALL:
+    return call(node);
+  default:
+    throw std::runtime_error("Cannot evaluate " + std::string(astTypeName(node.type())));
+  }
+}
+
+TreeWalker::Value TreeWalker::call(ASTRef node) {
+  ASTRef callee = std::get<ASTRef>(node.at(astid::CALL_FUNC));
+  Symbol name = std::get<Symbol>(callee.at(astid::VALUE));
+  auto args = std::get<AST::Array>(node.at(astid::CALL_ARGS));
+
+  auto it = m_functions.find(name.id);
+  if (it == m_functions.end()) {
+    if (m_symbols.name(name) != "print") {
+      throw std::runtime_error("Unknown function '" + std::string(m_symbols.name(name)) + "'");
+    }
+    for (size_t i = 0; i < args.size(); i++) {
+      m_out << eval(args[i]) << (i + 1 == args.size() ? '\n' : ' ');
+    }
+    if (args.empty()) {
+      m_out << '\n';
+    }
+    return int64_t(0);
+  }
+
+  ASTRef function = it->second;
+  auto params = std::get<AST::Array>(function.at(astid::FUNCTION_PARAMS));
+  Scope scope;
+  for (size_t i = 0; i < params.size(); i++) {
+    Value value = convert(eval(args[i]), std::get<Symbol>(params[i].at(astid::VAR_TYPE)));
+    scope[std::get<Symbol>(params[i].at(astid::VAR_NAME)).id] = value;
+  }
+
+  // The callee sees its own scopes and the globals, not the caller's.
+  std::vector<Scope> caller;
+  std::swap(caller, m_scopes);
+  m_scopes.push_back(std::move(scope));
+  Value result = eval(std::get<ASTRef>(function.at(astid::FUNCTION_BODY)));
+  std::swap(caller, m_scopes);
+  return convert(result, std::get<Symbol>(function.at(astid::FUNCTION_RETTYPE)));
+}
+
+TreeWalker::Value TreeWalker::binary(ASTRef node) {
+  auto op = std::get<std::string_view>(node.at(astid::BINARY_OP));
+  ASTRef left = std::get<ASTRef>(node.at(astid::BINARY_LEFT));
+  ASTRef right = std::get<ASTRef>(node.at(astid::BINARY_RIGHT));
+
+  if (op == "&&") {
+    return truthy(eval(left)) && truthy(eval(right));
+  }
+  if (op == "||") {
+    return truthy(eval(left)) || truthy(eval(right));
+  }
+
+  Value l = eval(left);
+  Value r = eval(right);
+  if (std::holds_alternative<std::string>(l)) {
+    return op == "==" ? l == r : l != r;
+  }
+  if (isReal(l) || isReal(r)) {
+    double a = asReal(l), b = asReal(r);
+    if (op == "+") return a + b;
+    if (op == "-") return a - b;
+    if (op == "*") return a * b;
+    if (op == "/") return a / b;
+    if (op == "%") return std::fmod(a, b);
+    if (op == "==") return a == b;
+    if (op == "!=") return a != b;
+    if (op == "<") return a < b;
+    if (op == ">") return a > b;
+    if (op == "<=") return a <= b;
+    if (op == ">=") return a >= b;
+  } else {
+    int64_t a = asInt(l), b = asInt(r);
+    if ((op == "/" || op == "%") && b == 0) {
+      throw std::runtime_error("Division by zero");
+    }
+    if (op == "+") return a + b;
+    if (op == "-") return a - b;
+    if (op == "*") return a * b;
+    if (op == "/") return a / b;
+    if (op == "%") return a % b;
+    if (op == "==") return a == b;
+    if (op == "!=") return a != b;
+    if (op == "<") return a < b;
+    if (op == ">") return a > b;
+    if (op == "<=") return a <= b;
+    if (op == ">=") return a >= b;
+  }
+  throw std::runtime_error("Cannot evaluate operator '" + std::string(op) + "'");
+}
+
+TreeWalker::Value &TreeWalker::lookup(Symbol name) {
+  for (auto it = m_scopes.rbegin(); it != m_scopes.rend(); it++) {
+    if (auto found = it->find(name.id); found != it->end()) {
+      return found->second;
+    }
+  }
+  if (auto found = m_globals.find(name.id); found != m_globals.end()) {
+    return found->second;
+  }
+  throw std::runtime_error("Unknown name '" + std::string(m_symbols.name(name)) + "'");
+}
+
+TreeWalker::Value TreeWalker::convert(Value value, Symbol type) {
+  auto name = m_symbols.name(type);
+  if (name == "float") {
+    return asReal(value);
+  }
+  if (name == "int") {
+    return asInt(value);
+  }
+  if (name == "bool") {
+    return asInt(value) != 0;
+  }
+  if (name == "char") {
+    return static_cast<char>(asInt(value));
+  }
+  return value;
+}
+
+std::ostream &operator <<(std::ostream &os, const TreeWalker::Value &value) {
+  std::visit([&os](const auto &v) {
+    if constexpr (std::is_same_v<std::decay_t<decltype(v)>, bool>) {
+      os << (v ? "true" : "false");
+    } else {
+      os << v;
+    }
+  }, value);
+  return os;
+}
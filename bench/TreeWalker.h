@@ -0,0 +1,42 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include "AST.h"
+
+// The evaluator the VM is measured against: a direct walk over ASTRef::at()
+// with tagged values and a hash map per scope, the way ad-hoc interpreters
+// over this AST are usually written. It follows the compiler's rules for
+// the programs the bench runs, not for every program the compiler accepts.
+class TreeWalker {
+public:
+  using Value = std::variant<int64_t, double, bool, char, std::string>;
+
+private:
+  using Scope = std::unordered_map<uint32_t, Value>;
+
+  const AST &m_ast;
+  const SymbolTable &m_symbols;
+  std::ostream &m_out;
+  std::unordered_map<uint32_t, ASTRef> m_functions;
+  Scope m_globals;
+  std::vector<Scope> m_scopes;
+
+public:
+  TreeWalker(const AST &ast, const SymbolTable &symbols, std::ostream &out);
+
+  Value run();
+
+private:
+  Value eval(ASTRef node);
+  Value call(ASTRef node);
+  Value binary(ASTRef node);
+  Value &lookup(Symbol name);
+  Value convert(Value value, Symbol type);
+};
+
+std::ostream &operator <<(std::ostream &os, const TreeWalker::Value &value);
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "Operator.h"
+#include "Symbol.h"
+
+enum class ASTType : uint8_t {
+  NONE,
+  EOB,
+  NAME,
+  BOOL,
+  INTEGER,
+  FLOAT,
+  STRING,
+  CHAR,
+
+  PROG,
+  FUNCTION,
+  CALL,
+  VAR,
+  BINARY,
+  ASSIGN,
+  IF,
+  UNARY,
+};
+
+namespace astid {
+  #define AST_ID constexpr uint32_t
+
+  AST_ID VALUE = 10;
+  AST_ID PROG = 20;
+  AST_ID FUNCTION_NAME = 30;
+  AST_ID FUNCTION_PARAMS = 31;
+  AST_ID FUNCTION_BODY = 32;
+  AST_ID FUNCTION_RETTYPE = 33;
+  AST_ID CALL_FUNC = 40;
+  AST_ID CALL_ARGS = 41;
+  AST_ID VAR_NAME = 50;
+  AST_ID VAR_TYPE = 51;
+  AST_ID VAR_INITVAL = 52;
+  AST_ID BINARY_LEFT = 60;
+  AST_ID BINARY_RIGHT = 61;
+  AST_ID BINARY_OP = 62;
+  AST_ID IF_COND = 70;
+  AST_ID IF_THEN = 71;
+  AST_ID IF_ELSE = 72;
+  AST_ID UNARY_OP = 80;
+  AST_ID UNARY_OPERAND = 81;
+
+  #undef AST_ID
+} // namespace ASTNodeID
+
+// Index of a node in its AST's arena.
+using NodeId = uint32_t;
+constexpr NodeId NO_NODE = UINT32_MAX;
+
+// Contiguous run of child ids in the AST's list pool.
+struct NodeList {
+  uint32_t begin;
+  uint32_t size;
+};
+
+// Bytes in the AST's string pool.
+struct StringRef {
+  uint32_t offset;
+  uint32_t size;
+};
+
+// Fixed-size node: the payload for each ASTType lives in its own struct and
+// children are referenced by NodeId, so nodes can be stored flat and copied
+// as plain bytes.
+struct ASTNode {
+  struct Prog {
+    NodeList body;
+  };
+  struct Function {
+    Symbol name;
+    NodeList params;
+    NodeId body;
+    Symbol retType;
+  };
+  struct Call {
+    NodeId func;
+    NodeList args;
+  };
+  struct Var {
+    Symbol name;
+    Symbol type;
+    NodeId init;
+  };
+  struct Binary { // also ASSIGN
+    Operator op;
+    NodeId left;
+    NodeId right;
+  };
+  struct Unary {
+    Operator op;
+    NodeId operand;
+  };
+  struct If {
+    NodeId cond;
+    NodeId then;
+    NodeId else_;
+  };
+
+  ASTType type = ASTType::NONE;
+  // Source offset of the token the node was parsed from; see SourceMap.
+  uint32_t offset = 0;
+
+  union {
+    int64_t integer = 0;
+    bool boolean;
+    double real;
+    char character;
+    StringRef string;
+    Symbol name;
+    Prog prog;
+    Function function;
+    Call call;
+    Var var;
+    Binary binary;
+    Unary unary;
+    If if_;
+  };
+};
+
+class AST;
+
+// Read-only handle to one node. Its at() gives the astid:: keyed view that
+// consumers of the old map-per-node AST were written against.
+class ASTRef {
+private:
+  const AST *m_ast = nullptr;
+  NodeId m_id = NO_NODE;
+
+public:
+  using ValueType = std::variant<
+    std::nullptr_t,
+    bool,
+    int64_t,
+    double,
+    char,
+    std::string_view,
+    Symbol,
+    ASTRef,
+    std::vector<ASTRef>
+  >;
+
+  ASTRef() = default;
+  ASTRef(const AST *ast, NodeId id) : m_ast(ast), m_id(id) { }
+
+  inline NodeId id() const {
+    return m_id;
+  }
+  const ASTNode &node() const;
+  ASTType type() const;
+
+  ValueType at(uint32_t id) const;
+
+  friend inline bool operator ==(const ASTRef &lhs, const ASTType &rhs) {
+    return lhs.type() == rhs;
+  }
+  inline bool operator !() const {
+    return m_ast == nullptr || m_id == NO_NODE || type() == ASTType::NONE;
+  }
+
+  friend std::ostream &operator <<(std::ostream &os, const ASTRef &ref);
+};
+
+// Arena holding every node of one parse. Nodes, child lists and literal text
+// are each kept in one contiguous pool and addressed by 32-bit indices.
+//
+// Reads go through views of the pools rather than the pools themselves, so
+// an AST can also read a mapped cache image in place (see ASTCache). The
+// first change to such an AST copies the image into its own pools.
+class AST {
+private:
+  std::vector<ASTNode> m_nodes;
+  std::vector<NodeId> m_lists;
+  std::string m_strings;
+  NodeId m_root = NO_NODE;
+
+  std::span<const ASTNode> m_nodeView;
+  std::span<const NodeId> m_listView;
+  std::string_view m_stringView;
+  std::shared_ptr<const void> m_image; // keeps the mapped views alive
+
+public:
+  using Ptr = ASTRef;
+  using Array = std::vector<ASTRef>;
+  using ValueType = ASTRef::ValueType;
+
+  AST() = default;
+  AST(const AST &other);
+  AST(AST &&other) noexcept;
+  AST &operator =(const AST &other);
+  AST &operator =(AST &&other) noexcept;
+
+  NodeId add(const ASTNode &node);
+  NodeList addList(std::span<const NodeId> ids);
+  // Replaces the `count` ids of `list` from `at` on by `ids`. The list is
+  // changed in place when its size stays or it is the newest list, and is
+  // copied to the end of the pool otherwise.
+  NodeList spliceList(NodeList list, uint32_t at, uint32_t count, std::span<const NodeId> ids);
+  StringRef addString(std::string_view text);
+
+  // Reads the given pools in place. `image` owns the memory they point into.
+  void adopt(std::shared_ptr<const void> image, std::span<const ASTNode> nodes, std::span<const NodeId> lists, std::string_view strings, NodeId root);
+
+  inline ASTNode &node(NodeId id) {
+    if (m_image) {
+      thaw();
+    }
+    return m_nodes[id];
+  }
+  inline const ASTNode &node(NodeId id) const {
+    return m_nodeView[id];
+  }
+  inline std::span<const NodeId> list(NodeList list) const {
+    return m_listView.subspan(list.begin, list.size);
+  }
+  inline std::string_view string(StringRef ref) const {
+    return m_stringView.substr(ref.offset, ref.size);
+  }
+
+  // The pools as stored, for writing them out.
+  inline std::span<const ASTNode> nodes() const {
+    return m_nodeView;
+  }
+  inline std::span<const NodeId> lists() const {
+    return m_listView;
+  }
+  inline std::string_view strings() const {
+    return m_stringView;
+  }
+  inline bool mapped() const {
+    return m_image != nullptr;
+  }
+
+  inline NodeId root() const {
+    return m_root;
+  }
+  inline void setRoot(NodeId id) {
+    m_root = id;
+  }
+  inline size_t size() const {
+    return m_nodeView.size();
+  }
+
+  inline ASTRef ref(NodeId id) const {
+    return ASTRef(this, id);
+  }
+  inline ASTRef ref() const {
+    return ASTRef(this, m_root);
+  }
+
+  // Sizes of the pools, to rewind() to once what was added after is no
+  // longer needed.
+  struct Mark {
+    size_t nodes;
+    size_t lists;
+    size_t strings;
+  };
+  inline Mark mark() const {
+    return Mark{ m_nodeView.size(), m_listView.size(), m_stringView.size() };
+  }
+  // Drops everything added since `mark`; nothing kept may refer to it.
+  void rewind(Mark mark);
+
+  // Drops every node but keeps the pools' capacity for the next parse.
+  void clear();
+
+  friend std::ostream &operator <<(std::ostream &os, const AST &ast);
+
+private:
+  // Copies a mapped image into the pools, which every change needs.
+  void thaw();
+  // Points the views back at the pools.
+  void sync();
+};
+
+std::string_view astTypeName(ASTType type);
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "AST.h"
+
+// Directory of parsed ASTs, one file per distinct source text, named by a
+// hash of that text. A file holds the AST's pools byte for byte as they sit
+// in memory, and every reference in them is an index, so loading maps the
+// file and points the AST at it: nothing is decoded, and only the pages a
+// consumer touches are read. The symbol names are interned into the
+// caller's table on load.
+//
+// The layout is that of this build's ASTNode, so a file from a build with a
+// different node layout, version or byte order is ignored and rewritten.
+class ASTCache {
+public:
+  // Bump whenever ASTNode, or an enum stored in it, changes.
+  static constexpr uint32_t VERSION = 2;
+
+  struct Key {
+    uint64_t hash;
+    uint64_t size;
+  };
+
+private:
+  std::string m_dir;
+
+public:
+  explicit ASTCache(std::string dir);
+
+  static Key keyOf(std::string_view source);
+  std::string path(Key key) const;
+
+  // Fills `ast` from the cached file for `key`, interning its symbols into
+  // `symbols`. Returns false, leaving both untouched, when there is no file
+  // or it is truncated, corrupt, stale or from an incompatible build.
+  bool load(Key key, SymbolTable &symbols, AST &ast) const;
+
+  // Writes `ast` for `key`, replacing any existing file atomically.
+  void store(Key key, const SymbolTable &symbols, const AST &ast) const;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string_view>
+
+// Allocation profiling. Build with SKWIRL_ALLOCS=1 (`make allocs`) to
+// replace the global operator new and delete with counting versions, which
+// charge every allocation to the innermost ALLOC_SITE() active on the
+// calling thread. Otherwise ALLOC_SITE() expands to nothing and the
+// allocator is left alone.
+#ifndef SKWIRL_ALLOCS
+#define SKWIRL_ALLOCS 0
+#endif
+
+namespace allocs {
+  enum class Site : uint8_t {
+    OTHER,     // outside every site below
+    LEXER,     // tokenizing, token buffer growth included
+    STATEMENT, // Parser::parseStatement
+    ATOM,      // Parser::parseAtom
+    CALL,      // Parser::parseCall
+    BINARY,    // Parser::maybeBinary
+    LIST,      // Parser::delimited and the bodies of blocks
+    FUNCTION,  // Parser::parseFunction
+    FOLD,
+    RESOLVE,
+    COMPILE,
+    RUN,
+  };
+  inline constexpr size_t SITES = 12;
+
+  std::string_view siteName(Site site);
+
+  struct Counts {
+    uint64_t allocations = 0;
+    uint64_t bytes = 0; // as requested
+  };
+
+  struct Totals {
+    Counts sites[SITES];
+    Counts all;
+    uint64_t frees = 0;
+    // High-water mark of bytes allocated and not yet freed, as the allocator
+    // rounded them up.
+    uint64_t peakLive = 0;
+  };
+
+  // Limits a run must stay within; a run is checked against them by
+  // exceeds(). Unset limits are unbounded.
+  struct Budget {
+    double perToken = std::numeric_limits<double>::infinity();
+    double perNode = std::numeric_limits<double>::infinity();
+    uint64_t bytes = UINT64_MAX;
+    uint64_t peakLive = UINT64_MAX;
+
+    // Sets one limit from "per-token=N", "per-node=N", "bytes=N" or
+    // "peak=N"; false if `spec` is none of those.
+    bool parse(std::string_view spec);
+  };
+
+  // Writes totals and allocations per token and per AST node, followed by a
+  // line per site that allocated.
+  void print(std::ostream &os, const Totals &totals, uint64_t tokens, uint64_t nodes);
+  // Writes a line for each limit of `budget` the totals break; true if any.
+  bool exceeds(std::ostream &os, const Totals &totals, uint64_t tokens, uint64_t nodes, const Budget &budget);
+
+#if SKWIRL_ALLOCS
+  inline constexpr bool ENABLED = true;
+
+  // Makes `site` the current site of the calling thread until destroyed.
+  class Scope {
+  private:
+    Site m_previous;
+
+  public:
+    explicit Scope(Site site);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator =(const Scope &) = delete;
+  };
+
+  // Everything counted since the last reset(), across all threads.
+  Totals totals();
+  // Zeroes the counts; the peak starts again from what is live now.
+  void reset();
+#else
+  inline constexpr bool ENABLED = false;
+
+  inline Totals totals() {
+    return Totals{};
+  }
+  inline void reset() { }
+#endif
+} // namespace allocs
+
+#if SKWIRL_ALLOCS
+#define ALLOC_SITE(site) ::allocs::Scope allocSite_(::allocs::Site::site)
+#else
+#define ALLOC_SITE(site) ((void)0)
+#endif
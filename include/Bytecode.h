@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Static type of a value. Registers hold no tag: the compiler knows every
+// value's kind and picks the instruction that matches it.
+enum class ValueKind : uint8_t {
+  INT,
+  FLOAT,
+  BOOL,   // 0 or 1
+  CHAR,   // character code
+  STRING, // index into Program::strings; 0 is ""
+};
+
+std::string_view valueKindName(ValueKind kind);
+
+// One register: an unboxed int64 or double, as its kind says.
+union Slot {
+  int64_t i;
+  double f;
+};
+static_assert(sizeof(Slot) == 8);
+
+// X(name) for every opcode, in encoding order. Operands are registers of the
+// current frame unless noted; bx is the 16-bit b:c pair, sbx the same
+// signed.
+#define SKWIRL_OPCODES(X) \
+  X(MOVE)   /* a = b */ \
+  X(LOADI)  /* a = sbx */ \
+  X(LOADK)  /* a = constants[bx] */ \
+  X(LOADG)  /* a = globals[bx] */ \
+  X(STOREG) /* globals[bx] = a */ \
+  X(ADDI) X(SUBI) X(MULI) X(DIVI) X(MODI) /* a = b op c, int64 */ \
+  X(ADDF) X(SUBF) X(MULF) X(DIVF) X(MODF) /* a = b op c, double */ \
+  X(NEGI) X(NEGF) /* a = -b */ \
+  X(NOT)    /* a = b == 0 */ \
+  X(TESTI)  /* a = b != 0 */ \
+  X(TESTF)  /* a = b != 0.0 */ \
+  X(I2F)    /* a = double(b) */ \
+  X(EQI) X(NEI) X(LTI) X(LEI) /* a = b op c, int64 */ \
+  X(EQF) X(NEF) X(LTF) X(LEF) /* a = b op c, double */ \
+  X(JMP)    /* pc += sbx */ \
+  X(JMPF)   /* if a == 0, pc += sbx */ \
+  X(JMPT)   /* if a != 0, pc += sbx */ \
+  X(CALL)   /* a = functions[bx](a, a + 1, ...) */ \
+  X(RET)    /* return a */ \
+  X(PRINT)  /* print a as ValueKind b, then '\n' if c else ' ' */
+
+enum class OpCode : uint8_t {
+  #define SKWIRL_OPCODE_ENUM(name) name,
+  SKWIRL_OPCODES(SKWIRL_OPCODE_ENUM)
+  #undef SKWIRL_OPCODE_ENUM
+};
+
+std::string_view opCodeName(OpCode op);
+
+// Fixed 32-bit instruction. Jump offsets count from the instruction after
+// the jump.
+struct Instr {
+  OpCode op;
+  uint8_t a;
+  uint8_t b;
+  uint8_t c;
+
+  inline uint16_t bx() const {
+    return static_cast<uint16_t>(b | (c << 8));
+  }
+  inline int16_t sbx() const {
+    return static_cast<int16_t>(bx());
+  }
+};
+static_assert(sizeof(Instr) == 4);
+
+struct Function {
+  std::string name;
+  std::vector<ValueKind> params; // in registers 0..params.size()-1
+  ValueKind result = ValueKind::INT;
+  uint32_t registers = 0; // frame size
+  std::vector<Instr> code;
+  // Source offset of each instruction, for runtime errors.
+  std::vector<uint32_t> offsets;
+};
+
+// A compiled program: every function, plus the pools their instructions
+// index. functions[main] runs the top-level statements.
+struct Program {
+  std::vector<Function> functions;
+  std::vector<Slot> constants;
+  std::vector<std::string> strings{ "" };
+  uint32_t globals = 0;
+  uint32_t main = 0;
+};
+
+std::ostream &operator <<(std::ostream &os, const Program &program);
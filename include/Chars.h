@@ -1,12 +1,91 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
 #include <string>
+#include <string_view>
 
-bool isWhitespace(const char *c);
-bool isIdentifier(const char *c);
-bool isKeyword(const char *c);
-bool isDigit(const char *c);
-bool isStringQuote(const char *c);
-bool isCharQuote(const char *c);
-bool isOperator(const char *c);
-bool isPunctuator(const char *c);
+namespace charclass {
+  #define CHAR_CLASS constexpr uint8_t
+
+  CHAR_CLASS WHITESPACE = 1 << 0;
+  CHAR_CLASS IDENTIFIER = 1 << 1;
+  CHAR_CLASS DIGIT = 1 << 2;
+  CHAR_CLASS STRING_QUOTE = 1 << 3;
+  CHAR_CLASS CHAR_QUOTE = 1 << 4;
+  CHAR_CLASS OPERATOR = 1 << 5;
+  CHAR_CLASS PUNCTUATOR = 1 << 6;
+
+  #undef CHAR_CLASS
+} // namespace charclass
+
+constexpr std::array<uint8_t, 256> makeCharClasses() {
+  std::array<uint8_t, 256> table{};
+  for (unsigned char c : std::string_view(" \t\r\v\f")) {
+    table[c] |= charclass::WHITESPACE;
+  }
+  for (int c = 'a'; c <= 'z'; c++) {
+    table[c] |= charclass::IDENTIFIER;
+  }
+  for (int c = 'A'; c <= 'Z'; c++) {
+    table[c] |= charclass::IDENTIFIER;
+  }
+  for (int c = '0'; c <= '9'; c++) {
+    table[c] |= charclass::IDENTIFIER | charclass::DIGIT;
+  }
+  table['_'] |= charclass::IDENTIFIER;
+  table['"'] |= charclass::STRING_QUOTE;
+  table['\''] |= charclass::CHAR_QUOTE;
+  for (unsigned char c : std::string_view("+-*/%&|^~!?:=<>")) {
+    table[c] |= charclass::OPERATOR;
+  }
+  for (unsigned char c : std::string_view(".,;()[]{}\n")) {
+    table[c] |= charclass::PUNCTUATOR;
+  }
+  return table;
+}
+
+inline constexpr std::array<uint8_t, 256> CHAR_CLASSES = makeCharClasses();
+
+namespace escape {
+  // The letter after a backslash, and the character the pair stands for.
+  inline constexpr std::string_view LETTERS = "abfnrtv\\'\"?";
+  inline constexpr std::string_view VALUES = "\a\b\f\n\r\t\v\\'\"?";
+} // namespace escape
+
+// Indexed by letter gives the escaped character, indexed by character gives
+// its letter (`reverse`); 0 where there is none. Any other character after a
+// backslash stands for itself.
+constexpr std::array<char, 256> makeEscapes(bool reverse) {
+  std::array<char, 256> table{};
+  for (size_t i = 0; i < escape::LETTERS.size(); i++) {
+    char from = reverse ? escape::VALUES[i] : escape::LETTERS[i];
+    char to = reverse ? escape::LETTERS[i] : escape::VALUES[i];
+    table[static_cast<unsigned char>(from)] = to;
+  }
+  return table;
+}
+
+inline constexpr std::array<char, 256> ESCAPE_VALUES = makeEscapes(false);
+inline constexpr std::array<char, 256> ESCAPE_LETTERS = makeEscapes(true);
+
+inline bool hasCharClass(char c, uint8_t cls) {
+  return (CHAR_CLASSES[static_cast<unsigned char>(c)] & cls) != 0;
+}
+
+inline bool isWhitespace(char c) { return hasCharClass(c, charclass::WHITESPACE); }
+inline bool isIdentifier(char c) { return hasCharClass(c, charclass::IDENTIFIER); }
+inline bool isDigit(char c) { return hasCharClass(c, charclass::DIGIT); }
+inline bool isStringQuote(char c) { return hasCharClass(c, charclass::STRING_QUOTE); }
+inline bool isCharQuote(char c) { return hasCharClass(c, charclass::CHAR_QUOTE); }
+inline bool isOperator(char c) { return hasCharClass(c, charclass::OPERATOR); }
+inline bool isPunctuator(char c) { return hasCharClass(c, charclass::PUNCTUATOR); }
+
+// Run scanners: each returns the first pointer in [begin, end) that does not
+// continue the run, or `end`. They use SSE2/AVX2 when the CPU has them and
+// fall back to the table above otherwise; the choice is made once at startup.
+const char *scanWhitespace(const char *begin, const char *end);
+const char *scanIdentifier(const char *begin, const char *end);
+const char *scanLine(const char *begin, const char *end);
+// Literal body: stops at `quote` ('"' or '\'') or a backslash.
+const char *scanLiteral(const char *begin, const char *end, char quote);
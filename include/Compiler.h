@@ -0,0 +1,87 @@
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "AST.h"
+#include "Bytecode.h"
+#include "Resolver.h"
+
+// Compiles a resolved program to register bytecode for the VM.
+//
+// Every name and every expression's kind comes from the Resolver, which has
+// already rejected anything ill-typed, so values need no tags and each
+// operation compiles to the instruction for its operand kinds, with ints
+// widened to float where the two meet. Globals and functions are used by
+// their index; the locals of blocks and functions live in registers of their
+// frame, found by slot. `print(...)` is built in.
+class Compiler {
+private:
+  const AST &m_ast;
+  const SymbolTable &m_symbols;
+  const Semantics &m_semantics;
+  Program m_program;
+
+  std::unordered_map<uint64_t, uint16_t> m_constants;
+  std::unordered_map<std::string_view, uint16_t> m_strings;
+
+  // State of the function being compiled.
+  Function *m_function = nullptr;
+  std::vector<uint8_t> m_registers; // of each local, by slot
+  uint32_t m_freeReg = 0;
+  // Operators of the chains being compiled, innermost last. Chains are as
+  // long as the source makes them, so they are compiled in loops over this.
+  std::vector<NodeId> m_chain;
+
+  // Source offset stamped on emitted instructions.
+  uint32_t m_offset = 0;
+
+public:
+  Compiler(const AST &ast, const SymbolTable &symbols, const Semantics &semantics);
+
+  Program operator()();
+
+private:
+  void declare();
+  void compileFunction(uint32_t index);
+  void compileMain();
+  void begin(uint32_t index);
+  void end();
+
+  ValueKind expr(NodeId id, uint8_t dst);
+  ValueKind prog(NodeList body, uint8_t dst);
+  ValueKind var(NodeId id, uint8_t dst);
+  // An ASSIGN and those down its right spine, `a = b = c`.
+  ValueKind assign(NodeId id, uint8_t dst);
+  // A BINARY and those down its left spine, `a + b + c`. Each operator
+  // leaves its value in dst, where the next one takes it from, so however
+  // long the chain, it needs registers only for one right operand.
+  ValueKind chain(NodeId id, uint8_t dst);
+  // One operator of a chain, its left operand's value in `l`.
+  ValueKind binary(const ASTNode &node, uint8_t l, ValueKind lk, uint8_t dst);
+  ValueKind logical(const ASTNode &node, ValueKind lk, uint8_t dst);
+  ValueKind unary(NodeId id, uint8_t dst);
+  ValueKind branch(NodeId id, uint8_t dst);
+  ValueKind call(NodeId id, uint8_t dst);
+
+  // Register holding the node's value: a local's own register when the node
+  // names one, else a fresh temporary it is compiled into.
+  uint8_t operand(NodeId id, ValueKind &kind);
+  uint8_t alloc();
+  // Widens an int to float where the Resolver allowed it.
+  void convert(uint8_t reg, ValueKind from, ValueKind to);
+  // Normalizes a value in place to a BOOL 0 or 1.
+  void toBool(uint8_t reg, ValueKind kind);
+  // Whether evaluating the node cannot change any local, looking at no more
+  // than `budget` nodes.
+  bool pure(NodeId id, int &budget) const;
+
+  size_t emit(OpCode op, uint8_t a = 0, uint8_t b = 0, uint8_t c = 0);
+  size_t emitBx(OpCode op, uint8_t a, uint32_t bx);
+  void loadInt(uint8_t dst, int64_t value);
+  void loadConstant(uint8_t dst, Slot value);
+  void patch(size_t jump);
+  void patchTo(size_t jump, size_t target);
+
+  [[noreturn]] void error(const std::string &message, const ASTNode &at) const;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// Per-phase hardware counters. A Scope placed around a phase adds that
+// phase's wall time, and whatever the CPU counted on the calling thread
+// meanwhile, to a file's Profile. Counters are read through perf_event_open;
+// where that is not allowed (a restricted container, a kernel without PMU
+// access, a system other than Linux) a Profile still gets the timings and
+// just reports no counts.
+//
+// Everything is opt-in: a Scope given no Profile reads nothing.
+namespace counters {
+  enum class Phase : uint8_t {
+    LEX,     // tokenizing the whole input, before parsing begins
+    PARSE,   // building the AST; includes the lexing of an ON_DEMAND parse
+    FOLD,
+    RESOLVE,
+    COMPILE,
+    RUN,
+  };
+  inline constexpr size_t PHASES = 6;
+
+  enum class Event : uint8_t {
+    CYCLES,
+    INSTRUCTIONS,
+    L1D_MISSES,    // L1 data cache read misses
+    LLC_MISSES,    // last-level cache misses
+    BRANCH_MISSES,
+  };
+  inline constexpr size_t EVENTS = 5;
+
+  std::string_view phaseName(Phase phase);
+  std::string_view eventName(Event event);
+
+  // A snapshot of the calling thread's counters.
+  struct Reading {
+    std::chrono::steady_clock::time_point time;
+    uint64_t values[EVENTS] = {};
+    uint64_t enabled = 0; // ns the counter group was enabled and running,
+    uint64_t running = 0; // for scaling counts the kernel multiplexed
+    uint8_t counted = 0;  // bit per Event that could be opened
+
+    static Reading now();
+  };
+
+  struct Totals {
+    uint32_t scopes = 0; // times the phase was entered; 0 if it never ran
+    uint64_t nanos = 0;
+    uint64_t values[EVENTS] = {};
+  };
+
+  // What every phase of one file cost.
+  class Profile {
+  private:
+    Totals m_phases[PHASES];
+    uint8_t m_counted = 0; // Events every scope could count
+    bool m_started = false;
+
+  public:
+    void add(Phase phase, const Reading &start, const Reading &end);
+
+    inline const Totals &operator [](Phase phase) const {
+      return m_phases[static_cast<size_t>(phase)];
+    }
+    inline bool counted(Event event) const {
+      return (m_counted >> static_cast<unsigned>(event)) & 1;
+    }
+
+    // A table of the phases that ran, one row each, for people.
+    void printTable(std::ostream &os, std::string_view path) const;
+    // The same as one line of JSON; counts that could not be read are null.
+    void printJson(std::ostream &os, std::string_view path) const;
+  };
+
+  // Charges the code between its construction and destruction to `phase` of
+  // `profile`. Only the calling thread is counted: work a phase hands to a
+  // thread pool (CHUNKED lexing) shows up in its time but not its counts.
+  class Scope {
+  private:
+    Profile *m_profile;
+    Phase m_phase;
+    Reading m_start;
+
+  public:
+    inline Scope(Profile *profile, Phase phase) : m_profile(profile), m_phase(phase) {
+      if (m_profile != nullptr) {
+        m_start = Reading::now();
+      }
+    }
+    inline ~Scope() {
+      if (m_profile != nullptr) {
+        m_profile->add(m_phase, m_start, Reading::now());
+      }
+    }
+
+    Scope(const Scope &) = delete;
+    Scope &operator =(const Scope &) = delete;
+  };
+} // namespace counters
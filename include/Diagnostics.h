@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "SourceMap.h"
+
+enum class DiagnosticCode : uint8_t {
+  UNEXPECTED_CHARACTER,
+  UNEXPECTED_TOKEN,
+  EXPECTED_KEYWORD,
+  EXPECTED_OPERATOR,
+  EXPECTED_PUNCTUATOR,
+  EXPECTED_IDENTIFIER,
+  EXPECTED_TYPE,
+  EXPECTED_END,
+  EXPECTED_FUNCTION_BODY,
+  MALFORMED_NUMBER,
+  NUMBER_OUT_OF_RANGE,
+  MALFORMED_CHAR,
+  UNTERMINATED_LITERAL,
+  NESTED_TOO_DEEPLY,
+};
+
+// One problem found in a source: what it is and where, nothing more. The
+// message, and the row and column, are only worked out when the diagnostic
+// is printed.
+struct Diagnostic {
+  DiagnosticCode code;
+  // The Keyword, Operator or punctuator character that was expected, the
+  // offending character, for a number or an unterminated literal its
+  // TokenType, or the nesting limit that was reached.
+  uint32_t arg = 0;
+  // Span of the offending token in the source.
+  uint32_t offset = 0;
+  uint32_t length = 0;
+};
+
+// Collects every diagnostic of a parse, in the order they were found.
+class Diagnostics {
+private:
+  std::vector<Diagnostic> m_diagnostics;
+
+public:
+  void report(const Diagnostic &diagnostic);
+
+  inline void clear() {
+    m_diagnostics.clear();
+  }
+  inline bool empty() const {
+    return m_diagnostics.empty();
+  }
+  inline size_t size() const {
+    return m_diagnostics.size();
+  }
+  inline const Diagnostic &operator [](size_t i) const {
+    return m_diagnostics[i];
+  }
+  inline const Diagnostic &back() const {
+    return m_diagnostics.back();
+  }
+  inline auto begin() const {
+    return m_diagnostics.begin();
+  }
+  inline auto end() const {
+    return m_diagnostics.end();
+  }
+
+  // Writes one "prefix: message" line per diagnostic; `source` maps the
+  // text they were found in.
+  void print(std::ostream &os, std::string_view prefix, const SourceMap &source) const;
+
+  // "message at row:col", as the parser used to throw it.
+  static std::string format(const Diagnostic &diagnostic, const SourceMap &source);
+};
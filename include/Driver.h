@@ -0,0 +1,61 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ASTCache.h"
+#include "Counters.h"
+#include "Parser.h"
+
+// Outcome of lexing and parsing one file. Each file gets its own symbol table
+// and AST arena, so results never share mutable state.
+struct ParseResult {
+  std::string path;
+  SymbolTable symbols;
+  AST ast;
+  // Syntax errors, every one in the file.
+  Diagnostics diagnostics;
+  // The file's text, still mapped, so that offsets in the AST and in errors
+  // about it can be turned into rows and columns.
+  Source source;
+  std::string error; // a failure to read the file at all; empty on success
+  size_t tokens = 0;  // lexed; 0 when the AST came from the cache
+  // Time and hardware counts per phase, when asked for. Callers running
+  // later phases on the AST add theirs to it.
+  counters::Profile profile;
+
+  inline bool ok() const {
+    return error.empty() && diagnostics.empty();
+  }
+
+  // Writes one "path: message" line per error.
+  void report(std::ostream &os) const;
+
+  // Empties it for another file, keeping the space its symbol table and AST
+  // have grown.
+  void clear();
+};
+
+struct DriverOptions {
+  unsigned jobs = 0; // 0 = one per hardware thread
+  TokenMode mode = TokenMode::PRELEXED;
+  std::string cacheDir; // empty = no AST cache
+  bool profile = false; // fill in each ParseResult::profile
+  uint32_t maxDepth = Parser::MAX_DEPTH; // at most Parser::MAX_DEPTH_CAP, see Parser::setMaxDepth()
+};
+
+// Parses every file on a work-stealing thread pool. Results come back in the
+// order of `paths`, whatever order the files finished in.
+std::vector<ParseResult> parseFiles(const std::vector<std::string> &paths, const DriverOptions &options = {});
+
+// Parses a single file on the calling thread. With a cache, an unchanged
+// file's AST is mapped from it instead, and a freshly parsed one is added.
+// With `profile`, the lex and parse phases are measured into its profile.
+ParseResult parseFile(const std::string &path, TokenMode mode = TokenMode::PRELEXED, const ASTCache *cache = nullptr,
+                      bool profile = false, uint32_t maxDepth = Parser::MAX_DEPTH);
+
+// parseFile() for text already in `result.source`, with `result` cleared:
+// its symbols and AST are filled in place, in whatever space they have.
+void parseSource(ParseResult &result, TokenMode mode = TokenMode::PRELEXED, const ASTCache *cache = nullptr,
+                 bool profile = false, uint32_t maxDepth = Parser::MAX_DEPTH);
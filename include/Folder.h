@@ -0,0 +1,82 @@
+#pragma once
+
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "AST.h"
+#include "Bytecode.h"
+
+// Rewrites a parsed program into a smaller one that compiles to the same
+// behaviour: operators over literal operands become literals, an `if` whose
+// condition is constant becomes the branch it takes, and a block holding a
+// single block or expression becomes that statement.
+//
+// The input is read once, in one pass, and the result is built into a fresh
+// arena; kept and folded nodes carry the source offset of the node they
+// came from. Anything whose outcome depends on the run, such as an integer
+// division by a literal zero, is left for the compiler and the VM to report.
+class Folder {
+private:
+  // A literal's value, as the compiler would load it.
+  struct Constant {
+    ValueKind kind;
+    Slot value;
+    std::string_view text; // STRING only
+  };
+
+  // An operator of a chain being folded.
+  struct Link {
+    NodeId node;
+    NodeId target; // of an ASSIGN, folded
+  };
+
+  const AST &m_ast;
+  AST m_out;
+  // Static kind of each node of m_out, where it can be told without
+  // resolving names.
+  std::vector<std::optional<ValueKind>> m_kinds;
+  size_t m_visited = 0;
+  size_t m_removed = 0;
+  // Operators of the chains being folded, innermost last. A chain may be as
+  // long as the source, so it is folded in a loop over these rather than by
+  // recursing down it.
+  std::vector<Link> m_chain;
+
+public:
+  explicit Folder(const AST &ast);
+
+  AST operator()();
+
+  // Input nodes that have no counterpart in the result.
+  inline size_t removed() const {
+    return m_removed;
+  }
+
+private:
+  // `used` is false where the statement's value is thrown away, which lets a
+  // dead statement vanish altogether (NO_NODE).
+  NodeId fold(NodeId id, bool used);
+  NodeId prog(const ASTNode &node, bool used);
+  // A BINARY and those down its left spine, `a + b + c`.
+  NodeId chain(NodeId id);
+  // An ASSIGN and those down its right spine, `a = b = c`.
+  NodeId assign(NodeId id);
+  // An operator whose left operand is folded already, to `left`; `mark` is
+  // where the output of its operands begins.
+  NodeId binary(const ASTNode &node, NodeId left, AST::Mark mark);
+  NodeId logical(const ASTNode &node, NodeId left, AST::Mark mark);
+  NodeId unary(const ASTNode &node);
+  NodeId branch(const ASTNode &node, bool used);
+  std::vector<NodeId> statements(NodeList body, bool used);
+  NodeList list(NodeList list);
+
+  NodeId emit(const ASTNode &node, std::optional<ValueKind> kind);
+  NodeId emit(const Constant &constant, const ASTNode &at);
+  bool constant(NodeId id, Constant &out) const;
+  static bool truthy(const Constant &constant);
+  void rewind(AST::Mark mark);
+  inline std::optional<ValueKind> kind(NodeId id) const {
+    return id == NO_NODE ? std::nullopt : m_kinds[id];
+  }
+};
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+// Fast non-cryptographic 64-bit hash for content keys and checksums. Input
+// is consumed a word at a time, so hashing runs near memory bandwidth; it
+// catches accidental change, not deliberate collisions.
+inline uint64_t hashBytes(std::string_view bytes, uint64_t seed = 0) {
+  constexpr uint64_t K0 = 0x9e3779b97f4a7c15;
+  constexpr uint64_t K1 = 0xbf58476d1ce4e5b9;
+  constexpr uint64_t K2 = 0x94d049bb133111eb;
+
+  auto mix = [](uint64_t h, uint64_t word) {
+    return std::rotl(h ^ (word * K0), 31) * K1;
+  };
+
+  uint64_t h = seed ^ (bytes.size() * K0);
+  const char *p = bytes.data();
+  size_t n = bytes.size();
+  for (; n >= 8; p += 8, n -= 8) {
+    uint64_t word;
+    std::memcpy(&word, p, 8);
+    h = mix(h, word);
+  }
+  if (n > 0) {
+    uint64_t word = 0;
+    std::memcpy(&word, p, n);
+    h = mix(h, word);
+  }
+
+  h ^= h >> 30;
+  h *= K1;
+  h ^= h >> 27;
+  h *= K2;
+  h ^= h >> 31;
+  return h;
+}
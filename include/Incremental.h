@@ -0,0 +1,83 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Parser.h"
+
+// Replacement of `length` bytes at `offset` by `text`. Offsets refer to the
+// text as it was before any edit of the same batch was applied.
+struct TextEdit {
+  uint32_t offset;
+  uint32_t length;
+  std::string text;
+};
+
+// Keeps a file's text, symbols and AST alive between edits. After an edit only
+// the top-level forms whose text was touched are lexed and parsed again; the
+// forms around them keep their nodes in the arena untouched. A node's offset
+// is kept relative to the start of its form, so moving a form past an edit
+// costs the same however many nodes it has.
+class IncrementalParser {
+private:
+  // One top-level form: its source span and the arena nodes it owns.
+  struct Form {
+    uint32_t start; // offset of its first token
+    uint32_t end;   // offset of the token after it
+    uint32_t id;    // index into m_bases
+    NodeId node;
+    NodeId firstNode; // nodes [firstNode, lastNode) were added by its parse
+    NodeId lastNode;
+  };
+
+  std::string m_text;
+  SymbolTable m_symbols;
+  AST m_ast;
+  std::vector<Form> m_forms;
+  // Start of every form parsed since the last full parse, by id; the root
+  // has id 0 and base 0. Updated along with the forms' own starts.
+  std::vector<uint32_t> m_bases;
+  // Form id of each node of the arena.
+  std::vector<uint32_t> m_formOf;
+
+  // Nodes of replaced forms still sitting in the arena.
+  size_t m_deadNodes = 0;
+  // False after a parse error: the next update starts from scratch.
+  bool m_valid = false;
+
+public:
+  IncrementalParser() = default;
+
+  IncrementalParser(const IncrementalParser &) = delete;
+  IncrementalParser &operator =(const IncrementalParser &) = delete;
+
+  // Replaces the whole text and parses it from scratch.
+  void reset(std::string text);
+
+  // Applies `edits` (non-overlapping) and brings the AST up to date. On a
+  // parse error the text keeps the edits and the AST stays at the last
+  // successful parse.
+  void update(const std::vector<TextEdit> &edits);
+
+  inline std::string_view text() const {
+    return m_text;
+  }
+  inline const SymbolTable &symbols() const {
+    return m_symbols;
+  }
+  // Offsets of its nodes are relative to their top-level form; offset()
+  // gives a node's offset in text().
+  inline const AST &ast() const {
+    return m_ast;
+  }
+  inline uint32_t offset(NodeId id) const {
+    return m_ast.node(id).offset + m_bases[m_formOf[id]];
+  }
+
+private:
+  void reparse();
+  // Parses the form at the parser's position into `ast`, and makes the
+  // offsets of its nodes relative to its start.
+  static Form parseForm(Parser &parser, AST &ast, uint32_t id);
+};
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+enum class Keyword : uint8_t {
+  NONE,
+  LET,
+  AS,
+  CONST,
+  DEFINE,
+  BEGIN,
+  DO,
+  END,
+  IF,
+  THEN,
+  ELSE,
+  TRUE,
+  FALSE,
+};
+
+namespace keyword {
+  // Spelling of every keyword, in Keyword order (starting after NONE).
+  inline constexpr std::string_view NAMES[] = {
+    "let", "as", "const", "define", "begin", "do", "end", "if", "then", "else", "true", "false",
+  };
+  inline constexpr size_t COUNT = std::size(NAMES);
+  inline constexpr size_t MIN_LENGTH = 2;
+  inline constexpr size_t MAX_LENGTH = 6;
+
+  // Perfect hash over (first char, last char, length). The multipliers are
+  // searched for at compile time; the static_assert below fails the build
+  // if a new keyword makes the set collide.
+  inline constexpr uint32_t TABLE_SIZE = 32;
+
+  struct Seed {
+    uint32_t first;
+    uint32_t last;
+  };
+
+  constexpr uint32_t hash(std::string_view word, Seed seed) {
+    return (seed.first * static_cast<unsigned char>(word.front())
+      + seed.last * static_cast<unsigned char>(word.back())
+      + static_cast<uint32_t>(word.size())) & (TABLE_SIZE - 1);
+  }
+
+  constexpr bool isPerfect(Seed seed) {
+    bool used[TABLE_SIZE] = {};
+    for (auto name : NAMES) {
+      auto h = hash(name, seed);
+      if (used[h]) {
+        return false;
+      }
+      used[h] = true;
+    }
+    return true;
+  }
+
+  constexpr Seed findSeed() {
+    for (uint32_t first = 1; first < 64; first++) {
+      for (uint32_t last = 1; last < 64; last++) {
+        if (isPerfect({ first, last })) {
+          return { first, last };
+        }
+      }
+    }
+    return { 0, 0 };
+  }
+
+  inline constexpr Seed SEED = findSeed();
+  static_assert(SEED.first != 0, "no perfect hash seed for the keyword set");
+
+  constexpr std::array<Keyword, TABLE_SIZE> makeTable() {
+    std::array<Keyword, TABLE_SIZE> table{};
+    for (size_t i = 0; i < COUNT; i++) {
+      table[hash(NAMES[i], SEED)] = static_cast<Keyword>(i + 1);
+    }
+    return table;
+  }
+
+  inline constexpr std::array<Keyword, TABLE_SIZE> TABLE = makeTable();
+} // namespace keyword
+
+constexpr std::string_view keywordName(Keyword kw) {
+  return kw == Keyword::NONE ? std::string_view() : keyword::NAMES[static_cast<size_t>(kw) - 1];
+}
+
+// One hash, one table load and at most one compare of the candidate.
+constexpr Keyword findKeyword(std::string_view word) {
+  if (word.size() < keyword::MIN_LENGTH || word.size() > keyword::MAX_LENGTH) {
+    return Keyword::NONE;
+  }
+  Keyword kw = keyword::TABLE[keyword::hash(word, keyword::SEED)];
+  return keywordName(kw) == word ? kw : Keyword::NONE;
+}
+
+static_assert(findKeyword("define") == Keyword::DEFINE);
+static_assert(findKeyword("false") == Keyword::FALSE);
+static_assert(findKeyword("defin") == Keyword::NONE);
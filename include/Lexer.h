@@ -1,11 +1,18 @@
 #pragma once
 
+#include <deque>
 #include <ios>
-#include <functional>
-#include <sstream>
+#include <optional>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <vector>
 
 #include "Chars.h"
+#include "Keyword.h"
+#include "Operator.h"
+#include "Source.h"
+#include "Symbol.h"
 
 enum class TokenType {
   NONE,
@@ -18,15 +25,56 @@ enum class TokenType {
   CHAR,
   OPERATOR,
   PUNCTUATOR,
+  // A character that starts no token. The lexer hands it on, one character
+  // long, and leaves reporting it to the parser.
+  INVALID,
 };
 
-extern std::unordered_map<char, char> escapeMap;
+// Value of an INTEGER or FLOAT token, read once when it is lexed.
+union Number {
+  int64_t integer;
+  double real;
+};
+
+namespace number {
+  // Ids of INTEGER and FLOAT tokens that have no value; every other id is
+  // the 1-based index of the value among the lexer's numbers.
+  constexpr uint32_t MALFORMED = 0;
+  constexpr uint32_t OUT_OF_RANGE = UINT32_MAX;
+} // namespace number
+
+namespace literal {
+  // Id of a STRING or CHAR token whose closing quote is missing: the input
+  // ended inside it.
+  constexpr uint32_t UNTERMINATED = UINT32_MAX;
+} // namespace literal
 
 struct Token {
   TokenType type = TokenType::NONE;
-  std::string value;
-  uint32_t row;
-  uint32_t col;
+  std::string_view value;
+  // Keyword for KEYWORD tokens, Operator for OPERATOR tokens, Symbol for
+  // IDENTIFIER tokens, for INTEGER/FLOAT tokens the 1-based number (see
+  // number::), and for STRING/CHAR tokens the 1-based escaped literal (see
+  // Lexer::cooked()), 0 if it has no escapes, or literal::UNTERMINATED.
+  // Either way value is the raw text between the quotes.
+  uint32_t id = 0;
+  // Source offset of value; for STRING/CHAR, of the raw text inside the
+  // quotes.
+  uint32_t offset = 0;
+
+  inline Keyword keyword() const {
+    return type == TokenType::KEYWORD ? static_cast<Keyword>(id) : Keyword::NONE;
+  }
+  inline Operator op() const {
+    return type == TokenType::OPERATOR ? static_cast<Operator>(id) : Operator::NONE;
+  }
+  inline Symbol symbol() const {
+    return type == TokenType::IDENTIFIER ? Symbol{ id } : Symbol{};
+  }
+  // Source offset of the token's first character, opening quote included.
+  inline uint32_t start() const {
+    return type == TokenType::STRING || type == TokenType::CHAR ? offset - 1 : offset;
+  }
 
   static const std::unordered_map<TokenType, std::string> typeNames;
 
@@ -41,28 +89,38 @@ struct Token {
   }
 
   friend inline std::ostream &operator <<(std::ostream &os, const Token &token) {
-    os << "Token(" << Token::typeNames.at(token.type) << ", `" << token.value << "`, " << token.row << ", " << token.col << ")";
+    os << "Token(" << Token::typeNames.at(token.type) << ", `" << token.value << "`, " << token.start() << ")";
     return os;
   }
 };
 
-class UnexpectedCharacterException : public std::exception {
-  std::string m_message;
-public:
-  UnexpectedCharacterException(char c, uint32_t row, uint32_t col);
-  const char* what() const noexcept override {
-    return m_message.c_str();
-  }
-};
+class TokenBuffer;
 
 class Lexer {
 private:
-  std::stringstream m_data;
-  uint32_t m_row = 0, m_col = 0, m_lastLineCol = 0;
+  Source m_source;
+  SymbolTable &m_symbols;
+  const char *m_begin, *m_cur, *m_end;
   Token m_currentToken;
 
+  // STRING/CHAR literals containing escapes, the only tokens whose value is
+  // not their text. Each is decoded the first time cooked() is asked for it;
+  // a deque, so decoded values stay put while more literals are added.
+  struct Escaped {
+    uint32_t offset;
+    uint32_t length;
+    std::optional<std::string> value;
+  };
+  mutable std::deque<Escaped> m_escaped;
+  std::vector<Number> m_numbers;
+
 public:
-  Lexer(std::basic_istream<char> &stream);
+  Lexer(Source source, SymbolTable &symbols);
+  Lexer(std::basic_istream<char> &stream, SymbolTable &symbols);
+  Lexer(std::string_view buffer, SymbolTable &symbols);
+
+  Lexer(const Lexer &) = delete;
+  Lexer &operator =(const Lexer &) = delete;
 
 public:
   char peekChar();
@@ -71,17 +129,58 @@ public:
   bool eof();
 
 private:
+  void skipTo(const char *to);
   void skipWhitespace();
   void skipComment();
 
-  std::string readWhile(std::function<bool(const char *)> predicate);
-  std::string readEscaped(char end);
+  // Reads a literal's body and its closing quote. Returns the raw text and
+  // sets `escaped` to the token id, literal::UNTERMINATED if the input ends
+  // first.
+  std::string_view readEscaped(char end, uint32_t &escaped);
+  // Reads a literal's digits, '_' separators included, and returns its
+  // token id.
+  uint32_t readNumber(std::string_view digits, int base, bool real, bool separated);
 
   Token readNextToken();
   Token readNumberToken();
   Token readIdentifierToken();
+  Token readLiteralToken(TokenType type, char end);
+  Token readInvalidToken();
+
+  inline uint32_t offset(const char *p) const {
+    return static_cast<uint32_t>(p - m_begin);
+  }
 
 public:
   Token nextToken();
   Token currentToken();
+
+  // Lexes everything that is left into `tokens` in one pass.
+  void tokenize(TokenBuffer &tokens);
+  // Same result as tokenize(), but large inputs are split at line boundaries
+  // and lexed on `jobs` threads (0 = one per hardware thread).
+  void tokenizeChunked(TokenBuffer &tokens, unsigned jobs = 0);
+
+  // Moves the read position to `offset` without lexing what lies between.
+  void seek(uint32_t offset);
+
+  // Read position: just past the last token read, peeked ones included.
+  inline uint32_t position() const {
+    return offset(m_cur);
+  }
+
+  inline SymbolTable &symbols() {
+    return m_symbols;
+  }
+  inline std::string_view source() const {
+    return std::string_view(m_begin, m_end - m_begin);
+  }
+  inline std::string_view text(uint32_t offset, uint32_t length) const {
+    return std::string_view(m_begin + offset, length);
+  }
+  // Decoded value of the escaped literal `id`.
+  std::string_view cooked(uint32_t id) const;
+  inline Number number(uint32_t id) const {
+    return m_numbers[id - 1];
+  }
 };
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+enum class Operator : uint8_t {
+  NONE,
+  ASSIGN,
+  OR,
+  AND,
+  EQ,
+  NE,
+  LT,
+  GT,
+  LE,
+  GE,
+  ADD,
+  SUB,
+  MUL,
+  DIV,
+  MOD,
+  NOT,
+};
+
+namespace op {
+  // How an operator binds. A precedence of 0 means the operator cannot be
+  // used in that position; higher binds tighter.
+  struct Info {
+    std::string_view name;
+    uint8_t binary;
+    uint8_t prefix;
+    bool rightAssoc;
+  };
+
+  // Indexed by Operator.
+  inline constexpr Info TABLE[] = {
+    { "", 0, 0, false },
+    { "=", 1, 0, true },
+    { "||", 3, 0, false },
+    { "&&", 4, 0, false },
+    { "==", 7, 0, false },
+    { "!=", 7, 0, false },
+    { "<", 7, 0, false },
+    { ">", 7, 0, false },
+    { "<=", 7, 0, false },
+    { ">=", 7, 0, false },
+    { "+", 10, 30, false },
+    { "-", 10, 30, false },
+    { "*", 20, 0, false },
+    { "/", 20, 0, false },
+    { "%", 20, 0, false },
+    { "!", 0, 30, false },
+  };
+  inline constexpr size_t COUNT = std::size(TABLE);
+  inline constexpr size_t MAX_LENGTH = 2;
+} // namespace op
+
+constexpr const op::Info &operatorInfo(Operator op) {
+  return op::TABLE[static_cast<size_t>(op)];
+}
+
+constexpr std::string_view operatorName(Operator op) {
+  return operatorInfo(op).name;
+}
+
+constexpr Operator findOperator(std::string_view text) {
+  for (size_t i = 1; i < op::COUNT; i++) {
+    if (op::TABLE[i].name == text) {
+      return static_cast<Operator>(i);
+    }
+  }
+  return Operator::NONE;
+}
+
+// Longest operator spelled at the start of `text` (maximal munch), so that
+// `=-` reads as `=` followed by `-`.
+constexpr Operator matchOperator(std::string_view text, size_t &length) {
+  for (length = std::min(text.size(), op::MAX_LENGTH); length > 0; length--) {
+    if (Operator op = findOperator(text.substr(0, length)); op != Operator::NONE) {
+      return op;
+    }
+  }
+  return Operator::NONE;
+}
+
+static_assert(findOperator("<=") == Operator::LE);
+static_assert(findOperator("=-") == Operator::NONE);
+static_assert(operatorName(Operator::NOT) == "!");
\ No newline at end of file
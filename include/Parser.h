@@ -1,167 +1,222 @@
 #pragma once
 
+#include "AST.h"
+#include "Diagnostics.h"
 #include "Lexer.h"
-#include <memory>
-#include <variant>
+#include "TokenBuffer.h"
+#include <algorithm>
 #include <vector>
 
-enum class ASTType {
-  NONE,
-  EOB,
-  NAME,
-  BOOL,
-  INTEGER,
-  FLOAT,
-  STRING,
-  CHAR,
-
-  PROG,
-  FUNCTION,
-  CALL,
-  VAR,
-  BINARY,
-  ASSIGN,
-  IF,
-};
-
-namespace astid {
-  #define AST_ID constexpr uint32_t
-  
-  AST_ID VALUE = 10;
-  AST_ID PROG = 20;
-  AST_ID FUNCTION_NAME = 30;
-  AST_ID FUNCTION_PARAMS = 31;
-  AST_ID FUNCTION_BODY = 32;
-  AST_ID FUNCTION_RETTYPE = 33;
-  AST_ID CALL_FUNC = 40;
-  AST_ID CALL_ARGS = 41;
-  AST_ID VAR_NAME = 50;
-  AST_ID VAR_TYPE = 51;
-  AST_ID VAR_INITVAL = 52;
-  AST_ID BINARY_LEFT = 60;
-  AST_ID BINARY_RIGHT = 61;
-  AST_ID BINARY_OP = 62;
-  AST_ID IF_COND = 70;
-  AST_ID IF_THEN = 71;
-  AST_ID IF_ELSE = 72;
-
-  #undef AST_ID
-} // namespace ASTNodeID
-
-extern const std::unordered_map<std::string, uint32_t> OPERATOR_PRECEDENCE;
-
-struct AST {
-  using Array = std::vector<AST>;
-  using Ptr = std::shared_ptr<AST>;
-  using Function = std::function<AST()>;
-
-  using ValueType = std::variant<
-    std::nullptr_t,
-    bool,
-    int64_t,
-    double,
-    char,
-    std::string,
-    AST::Ptr,
-    AST::Array
-  >;
-
-  ASTType type;
-  std::unordered_map<uint32_t, ValueType> values;
-
-  inline ValueType& operator[](uint32_t id) {
-    return values[id];
-  }
-
-  inline const ValueType& at(uint32_t id) const {
-    return values.at(id);
-  }
-
-  friend inline bool operator ==(const AST &lhs, const AST &rhs) {
-    return lhs.type == rhs.type;
-  }
-  friend inline bool operator ==(const AST &lhs, const ASTType &rhs) {
-    return lhs.type == rhs;
-  }
-  inline bool operator !() const {
-    return type == ASTType::NONE;
-  }
-
-  friend std::ostream &operator <<(std::ostream &os, const AST &ast) {
-    static const std::unordered_map<ASTType, std::string> AST_TYPE_NAMES = {
-      { ASTType::NONE, "NONE" },
-      { ASTType::EOB, "EOB" },
-      { ASTType::NAME, "NAME" },
-      { ASTType::BOOL, "BOOL" },
-      { ASTType::INTEGER, "INTEGER" },
-      { ASTType::FLOAT, "FLOAT" },
-      { ASTType::STRING, "STRING" },
-      { ASTType::CHAR, "CHAR" },
-      { ASTType::PROG, "PROG" },
-      { ASTType::FUNCTION, "FUNCTION" },
-      { ASTType::CALL, "CALL" },
-      { ASTType::VAR, "VAR" },
-      { ASTType::BINARY, "BINARY" },
-      { ASTType::ASSIGN, "ASSIGN" },
-      { ASTType::IF, "IF" },
-    };
-    os << AST_TYPE_NAMES.at(ast.type);
-    return os;
-  }
-};
-
+// Expressions and blocks are parsed without recursion: each construct being
+// parsed is a Frame on an explicit stack, kept from one statement to the
+// next, and says at which Step to go on once the construct inside it is
+// done. However deep the input nests, the native stack stays flat.
 class Parser {
+public:
+  // Default for setMaxDepth().
+  static constexpr uint32_t MAX_DEPTH = 1024;
+  // Most setMaxDepth() allows. The folder, resolver and compiler still
+  // recurse once per level, at up to about 1 KB of native stack each in an
+  // unoptimized build; this many levels leave half of an 8 MB stack spare.
+  static constexpr uint32_t MAX_DEPTH_CAP = 4096;
+
 private:
+  enum class Step : uint8_t {
+    EXPRESSION,
+    CLOSE, // closes a level of nesting and returns what was inside it
+    ATOM,
+    ATOM_GROUP,
+    ATOM_CALL, // a name or literal parsed in place, then called
+    UNARY,
+    UNARY_BINARY,
+    UNARY_DONE,
+    BINARY,
+    BINARY_LEFT,
+    BINARY_RIGHT,
+    PROG,
+    PROG_ITEM,
+    IF,
+    IF_THEN,
+    IF_ELSE,
+    IF_DONE,
+    CALL,
+    CALL_DONE,
+    LIST,
+    LIST_ITEM,
+    FUNCTION,
+    FUNCTION_TYPE,
+    FUNCTION_BODY,
+    VAR,
+    VAR_DONE,
+  };
+
+  // What a recursive parse function would have kept in its locals, packed
+  // into 32 bytes.
+  struct Frame {
+    Step step;
+    Operator op = Operator::NONE; // BINARY: the operator; UNARY: the prefix
+    uint8_t minPrec;        // BINARY
+    Step item = Step::EXPRESSION; // LIST: what each item is
+    bool first = true;      // LIST: no item parsed yet
+    bool call = false;      // BINARY: an EXPRESSION's, so its value may be
+                            // called
+    bool atom = false;      // turned from an ATOM frame by open()
+    NodeId node = NO_NODE;  // the node being built
+    NodeId left;            // BINARY: the left operand; CALL, ATOM_CALL: the
+                            // callee; IF: the condition
+    NodeId right = NO_NODE; // BINARY: the right operand; IF: the then branch
+    uint32_t name = 0;      // VAR: the name's token
+    uint32_t type = 0;      // FUNCTION, VAR: the type's token
+    uint32_t mark = 0;      // PROG, LIST: m_scratch size at the start
+
+    explicit Frame(Step step, NodeId left = NO_NODE, uint8_t minPrec = 0)
+      : step(step), minPrec(minPrec), left(left) { }
+  };
+
   Lexer &m_lexer;
+  TokenCursor m_tokens;
+  AST m_ast;
+
+  // Child ids of lists still being parsed; each list is copied into the
+  // arena in one piece once its closing token is seen.
+  std::vector<NodeId> m_scratch;
+
+  std::vector<Frame> m_frames;
+  // What the last finished frame returned: a node, or for a LIST its list.
+  NodeId m_result = NO_NODE;
+  NodeList m_list{};
+  // Atoms waiting on a construct inside them, and how many may.
+  uint32_t m_depth = 0;
+  uint32_t m_maxDepth = MAX_DEPTH;
+
+  Diagnostics m_diagnostics;
+  // Set from an error until the parser is back at a statement boundary.
+  // While it is set nothing more is reported or consumed, so every parse
+  // function unwinds without the need for an exception.
+  bool m_panic = false;
 
 public:
-  Parser(Lexer &lexer);
+  Parser(Lexer &lexer, TokenMode mode = TokenMode::ON_DEMAND);
 
   AST operator ()();
+  // The same, but builds the AST in `ast`, replacing what it held and
+  // reusing the space it has already grown.
+  void operator ()(AST &ast);
+
+  // Parses the next top-level form into `ast`, appending to it, and returns
+  // the form's node; NO_NODE once the input is exhausted. Lets a caller
+  // parse a file one form at a time. A form with an error is returned all
+  // the same; the error is added to diagnostics() and parsing resumes after
+  // the form's line.
+  NodeId parseForm(AST &ast);
+
+  // Syntax errors found so far. A parse never stops at one: the statement
+  // it is in is dropped and the parse goes on with the next.
+  inline const Diagnostics &diagnostics() const {
+    return m_diagnostics;
+  }
+  inline Diagnostics &diagnostics() {
+    return m_diagnostics;
+  }
 
-private:
-  Token isTokenKeyword(const std::string &value);
-  Token isTokenOperator(const std::string &value);
-  Token isTokenPunctuator(const std::string &value);
-
-  void skipKeyword(const std::string &value);
-  void skipOperator(const std::string &value);
-  void skipPunctuator(const std::string &value);
-
-  template<typename T>
-  AST::Array delimited(const std::string &start, const std::string &stop, const std::string &separator, std::function<T()> parser) {
-    std::vector<T> a;
-    bool first = true;
-    skipPunctuator(start);
-    while (m_lexer.currentToken() != TokenType::EOB) {
-      if (!!isTokenPunctuator(stop)) {
-        break;
-      }
-      if (first) {
-        first = false;
-      } else {
-        skipPunctuator(separator);
-      }
-      if (!!isTokenPunctuator(stop)) {
-        break;
-      }
-      a.push_back(parser());
-    }
-    skipPunctuator(stop);
-
-    return a;
+  // The next token to be parsed.
+  Token currentToken();
+
+  // How deep brackets, blocks, calls, prefix operators and the other
+  // constructs holding an expression may nest in one another. A construct
+  // opened any deeper is reported as NESTED_TOO_DEEPLY. Chains of binary
+  // operators do not nest, however long they are. A depth over
+  // MAX_DEPTH_CAP is taken as MAX_DEPTH_CAP.
+  inline void setMaxDepth(uint32_t depth) {
+    m_maxDepth = std::min(depth, MAX_DEPTH_CAP);
   }
 
-  AST parseToplevel();
-  AST parseAtom();
-  AST parseExpression();
-  AST parseCall(AST function);
-  AST parseProg();
-  AST parseIf();
-  AST parseBool();
-  AST parseFunction();
-  AST parseVar();
-
-  AST maybeCall(AST::Function expr);
-  AST maybeBinary(AST expr, uint32_t prec);
+  // Tokens lexed for the parse so far.
+  inline size_t tokens() const {
+    return m_tokens.lexed();
+  }
+
+private:
+  bool isTokenKeyword(Keyword keyword);
+  bool isTokenOperator(Operator op);
+  bool isTokenPunctuator(std::string_view value);
+
+  // Consumes the current token and returns its index in the token buffer.
+  size_t nextToken();
+
+  // Reports an error at token `tok` unless one is already being recovered
+  // from, and enters panic mode.
+  void error(DiagnosticCode code, size_t tok, uint32_t arg = 0);
+  // error() at the current token, which is left unconsumed; returns a NONE
+  // node to stand in for what could not be parsed.
+  NodeId fail(DiagnosticCode code, uint32_t arg = 0);
+  // Leaves panic mode: skips the rest of the statement, blocks opened on the
+  // way included, up to and past its '\n'. Inside a block (`block`) it also
+  // stops before the `end` closing it.
+  void synchronize(bool block);
+
+  // Each consumes the expected token, or reports it missing and consumes
+  // nothing; false if it was not there.
+  bool skipKeyword(Keyword keyword);
+  bool skipOperator(Operator op);
+  bool skipPunctuator(const std::string &value);
+
+  Symbol symbolOf(size_t tok);
+
+  NodeId addNode(ASTType type, size_t tok);
+  NodeList popList(size_t mark);
+
+  // Runs frames from `start` until it returns, and returns its result.
+  NodeId parse(Frame start);
+  // Has `frame` go on at `resume` once `child`, pushed above it, returns.
+  void push(Frame &frame, Step resume, Frame child);
+  // push() one level of nesting deeper, to be closed by the `resume` step;
+  // `skip` consumes the token opening `child` first. If that is too deep,
+  // `frame` returns a NONE node and parsing unwinds in panic instead.
+  void nest(Frame &frame, Step resume, Frame child, bool skip = false);
+  // Like nest(), but turns the ATOM `frame` itself into `child`, saving a
+  // frame for the most common nested atoms. finish() then does what the
+  // ATOM frame would have: closes the level and makes any call of the atom.
+  void open(Frame &frame, Frame child, bool skip = false);
+  // Pops the top frame, which returns `node`. Like push() and nest(), it
+  // leaves `frame` dangling: a step returns right after.
+  void finish(NodeId node);
+
+  // Parses the atom at the current token for `frame`, which is to go on at
+  // `resume` with it. A name or a literal, the most common by far, is parsed
+  // in place: it is left in m_result, and the result is true. Anything else
+  // is pushed as an ATOM frame, and `frame` resumes once that returns.
+  bool atom(Frame &frame, Step resume);
+  // The same for an expression; one that is a lone name or literal is parsed
+  // in place.
+  bool expression(Frame &frame, Step resume);
+
+  NodeId parseToplevel();
+  NodeId parseStatement();
+  // A name or a literal, or NO_NODE if the current token starts neither.
+  NodeId parseLeaf();
+  NodeId parseBool();
+  // The type after `as`; returns its token.
+  size_t parseType();
+
+  // Each takes its frame one or more steps further.
+  //
+  // An expression is an atom, then the operators after it of any
+  // precedence, and then maybe a call of the whole; it turns its frame into
+  // a BINARY one to do all that.
+  void parseExpression(Frame &frame);
+  void parseAtom(Frame &frame);
+  // An atom may be called, once: `f(x)`.
+  void maybeCall(Frame &frame, NodeId atom);
+  void parseUnary(Frame &frame);
+  // Precedence climbing over op::TABLE: folds operators binding at least as
+  // tightly as `minPrec` into `left`.
+  void maybeBinary(Frame &frame);
+  void parseProg(Frame &frame);
+  void parseIf(Frame &frame);
+  void parseCall(Frame &frame);
+  // A parenthesized, comma-separated list of `item`s; returns it in m_list.
+  void delimited(Frame &frame);
+  void parseFunction(Frame &frame);
+  void parseVar(Frame &frame);
 };
\ No newline at end of file
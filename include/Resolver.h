@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AST.h"
+#include "Bytecode.h"
+
+// What name resolution and type checking found out about one AST, kept in
+// tables indexed by NodeId so that later passes look a node up instead of a
+// name.
+class Semantics {
+public:
+  // A function, in definition order; main, the top-level statements, is last.
+  struct Function {
+    NodeId node; // the FUNCTION node, or the root for main
+    Symbol name{};
+    std::vector<ValueKind> params;
+    ValueKind result = ValueKind::INT;
+    uint32_t locals = 0; // slots needed by its parameters and block lets
+  };
+
+  // slot() of a call to the builtin `print`.
+  static constexpr uint32_t PRINT = UINT32_MAX;
+
+private:
+  std::vector<ValueKind> m_kinds;
+  std::vector<uint16_t> m_depths;
+  std::vector<uint32_t> m_slots;
+  std::vector<Function> m_functions;
+  std::vector<ValueKind> m_globals;
+
+  friend class Resolver;
+
+public:
+  // The static kind of an expression's value; for a VAR or a parameter its
+  // declared type, for a FUNCTION its return type.
+  inline ValueKind kind(NodeId id) const {
+    return m_kinds[id];
+  }
+  // For a NAME, and for a VAR or parameter: how many scopes deep the
+  // variable was declared, 0 for a global, 1 for a parameter, and one more
+  // for each block around it.
+  inline uint16_t depth(NodeId id) const {
+    return m_depths[id];
+  }
+  // For a NAME, VAR or parameter: the variable's index among the globals at
+  // depth 0, else among its function's locals. For a CALL, the NAME it
+  // calls, or a FUNCTION: the function's index into functions(), or PRINT.
+  inline uint32_t slot(NodeId id) const {
+    return m_slots[id];
+  }
+
+  inline const std::vector<Function> &functions() const {
+    return m_functions;
+  }
+  inline const Function &main() const {
+    return m_functions.back();
+  }
+  // Kind of each global, by slot.
+  inline const std::vector<ValueKind> &globals() const {
+    return m_globals;
+  }
+};
+
+// Resolves every name of a parsed program and checks every operation's
+// operand types, with the language rules the Compiler relies on: top-level
+// `let`s are globals and `define`s functions, both visible everywhere; other
+// `let`s are visible from the next statement to the end of their block; a
+// function sees its parameters and the globals, not its caller's locals.
+//
+// Names are looked up in tables indexed by symbol id, and each scope undoes
+// its own declarations when it closes, so resolution takes time linear in
+// the size of the AST. Chains of operators, which the parser lets grow to
+// any length, are walked in loops; anything else nests no deeper than the
+// parser allows, which bounds the recursion. Function bodies only share the
+// read-only top-level tables, so with more than one job they are resolved in
+// parallel.
+//
+// Errors are thrown as SourceError; of several, the one the Compiler used to
+// meet first: declarations in order, then function bodies, then main.
+class Resolver {
+private:
+  class Walk;
+
+  static constexpr uint8_t NO_KIND = UINT8_MAX;
+  static constexpr uint32_t NONE = UINT32_MAX;
+
+  const AST &m_ast;
+  const SymbolTable &m_symbols;
+  Semantics m_out;
+
+  // Indexed by symbol id. NO_KIND/NONE where the name is no type, global or
+  // function.
+  std::vector<uint8_t> m_types;
+  std::vector<uint32_t> m_globalOf;
+  std::vector<uint32_t> m_functionOf;
+  Symbol m_print;
+
+public:
+  Resolver(const AST &ast, const SymbolTable &symbols);
+
+  // `jobs` as for the driver: 0 is one per hardware thread.
+  Semantics operator()(unsigned jobs = 1);
+
+private:
+  void declare(NodeId root);
+  ValueKind typeOf(Symbol type, const ASTNode &at) const;
+  [[noreturn]] void error(const std::string &message, const ASTNode &at) const;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ASTCache.h"
+#include "Driver.h"
+
+// How long requests took, counted in buckets a sixteenth of a power of two
+// wide: any percentile is read off to within about 6%, in constant memory
+// however many requests a server answers.
+class Latencies {
+private:
+  static constexpr unsigned SUB_BITS = 4;
+  static constexpr unsigned SUB_BUCKETS = 1 << SUB_BITS;
+  static constexpr size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_BUCKETS;
+
+  std::array<uint64_t, BUCKETS> m_counts{};
+  uint64_t m_samples = 0;
+  uint64_t m_max = 0;
+
+public:
+  void add(uint64_t nanos);
+
+  inline uint64_t samples() const {
+    return m_samples;
+  }
+  inline uint64_t max() const {
+    return m_max;
+  }
+  // Nanoseconds that at least `fraction` of the requests took no longer
+  // than: the top of the bucket the percentile falls in, or max() if less.
+  uint64_t percentile(double fraction) const;
+
+private:
+  static size_t bucketOf(uint64_t nanos);
+};
+
+// A long-lived parser for clients of a Unix domain socket, so that editors
+// and build tools pay for process startup and cold caches once rather than
+// per file. Each client gets a thread of its own; the arenas a request
+// parses into are pooled and handed from one request to the next, cleared
+// but never freed, and the AST cache is opened once for all of them.
+//
+// The protocol is line based. A request is one of
+//
+//   parse PATH [LENGTH]   parse PATH, or the LENGTH bytes after the line,
+//                         naming them PATH in messages
+//   check PATH [LENGTH]   parse, then resolve names and check types
+//   stats                 latency percentiles of the requests so far
+//   shutdown              stop once every open request is answered
+//
+// with words separated by spaces, so a PATH is one word. Each request is
+// answered by a "STATUS LENGTH" line and LENGTH bytes of output:
+// what `skwirl` prints for the file, or its errors. STATUS is 0 for success,
+// 1 for errors in the source and 2 for a malformed request. A LENGTH over
+// 256 MiB is refused with status 2, and the connection closed after it.
+class Server {
+public:
+  enum class Command : uint8_t {
+    PARSE,
+    CHECK,
+  };
+  static constexpr size_t COMMANDS = 2;
+
+private:
+  // What a request is parsed into. Kept between requests, so a warm one has
+  // its symbol table, AST arena and text buffer already grown.
+  struct Workspace {
+    ParseResult result;
+    std::string text; // source sent with the request
+  };
+
+  std::string m_path;
+  DriverOptions m_options;
+  std::unique_ptr<ASTCache> m_cache;
+  int m_listener = -1;
+
+  // Guards everything below.
+  mutable std::mutex m_mutex;
+  std::condition_variable m_closed;
+  std::vector<int> m_clients; // sockets of the connections being served
+  std::vector<std::unique_ptr<Workspace>> m_idle;
+  Latencies m_latencies[COMMANDS];
+  bool m_stopping = false;
+
+public:
+  // Listens on `path`, replacing a socket left there by an earlier server;
+  // throws std::runtime_error if it cannot.
+  Server(std::string path, const DriverOptions &options);
+  ~Server();
+
+  Server(const Server &) = delete;
+  Server &operator =(const Server &) = delete;
+
+  // Serves clients until one sends `shutdown`, and returns once every
+  // connection is closed.
+  void operator ()();
+
+  // One line per command: how many requests it had and their latency
+  // percentiles, timed from a request's line being read to its response
+  // being ready, so receiving the text sent with it counts too.
+  void printStats(std::ostream &os) const;
+
+private:
+  // Answers the requests of one connection until it is closed.
+  void serve(int fd);
+  void serveRequests(int fd);
+  // Runs a parse or check; returns the status and writes the output.
+  int handle(Command command, std::string_view path, Workspace &workspace, bool sent, std::ostream &out);
+  void stop();
+};
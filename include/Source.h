@@ -0,0 +1,43 @@
+#pragma once
+
+#include <istream>
+#include <string>
+#include <string_view>
+
+// The bytes a Lexer reads from. A Source either borrows a caller-owned
+// buffer, owns a copy slurped from a stream, or maps a file read-only, so
+// tokens can point straight into it as string_views.
+class Source {
+private:
+  const char *m_data = nullptr;
+  size_t m_size = 0;
+  std::string m_owned;
+  void *m_mapping = nullptr;
+  size_t m_mappingSize = 0;
+
+public:
+  Source() = default;
+  explicit Source(std::string_view buffer);
+  explicit Source(std::basic_istream<char> &stream);
+  ~Source();
+
+  Source(Source &&other) noexcept;
+  Source &operator =(Source &&other) noexcept;
+  Source(const Source &) = delete;
+  Source &operator =(const Source &) = delete;
+
+  static Source mapFile(const std::string &path);
+
+  inline const char *data() const {
+    return m_data;
+  }
+  inline size_t size() const {
+    return m_size;
+  }
+  inline std::string_view view() const {
+    return std::string_view(m_data, m_size);
+  }
+
+private:
+  void release();
+};
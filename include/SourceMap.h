@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct SourcePosition {
+  uint32_t row;
+  uint32_t col;
+};
+
+// Turns the byte offsets tokens and nodes carry into rows and columns, both
+// 0-based. The index of line starts is only built the first time a position
+// is asked for, so a parse that reports nothing never pays for it.
+class SourceMap {
+private:
+  std::string_view m_text;
+  uint32_t m_firstRow;
+  mutable std::vector<uint32_t> m_lines; // offset of each line's first byte
+
+public:
+  // `firstRow` is the row of the text's first line, for text cut out of a
+  // larger source.
+  explicit SourceMap(std::string_view text, uint32_t firstRow = 0);
+
+  inline std::string_view text() const {
+    return m_text;
+  }
+
+  SourcePosition position(uint32_t offset) const;
+  // "row:col", as error messages give it.
+  std::string locate(uint32_t offset) const;
+
+private:
+  void index() const;
+};
+
+// An error tied to a place in the source that the thrower cannot position
+// itself, such as a compile or runtime error. what() is the bare message;
+// whoever holds the source appends SourceMap::locate(offset()).
+class SourceError : public std::runtime_error {
+private:
+  uint32_t m_offset;
+
+public:
+  SourceError(const std::string &message, uint32_t offset);
+
+  inline uint32_t offset() const {
+    return m_offset;
+  }
+};
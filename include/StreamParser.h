@@ -0,0 +1,53 @@
+#pragma once
+
+#include <functional>
+#include <istream>
+#include <string>
+
+#include "Parser.h"
+
+// Parses an unbounded, possibly non-seekable stream one top-level statement
+// at a time. Input is read in fixed-size blocks and only the statement being
+// parsed is kept, so memory use depends on the longest statement rather than
+// on the length of the stream.
+class StreamParser {
+public:
+  // Receives each statement as soon as its trailing newline is read; the
+  // statement is `ast.root()`, and node offsets count from its first token.
+  // The AST is reused for the next statement.
+  using Statement = std::function<void(const AST &ast)>;
+  // Receives each syntax error as it is found, with a map of the text it
+  // was found in that is only good for the call.
+  using Error = std::function<void(const Diagnostic &diagnostic, const SourceMap &source)>;
+
+  static constexpr size_t BLOCK_SIZE = 64 * 1024;
+
+private:
+  std::istream &m_stream;
+  SymbolTable &m_symbols;
+  size_t m_blockSize;
+
+  // Unparsed input: [m_start, m_lines) holds whole lines ready for the
+  // lexer, anything after that is a line still being read.
+  std::string m_window;
+  size_t m_start = 0;
+  size_t m_lines = 0;
+  bool m_done = false;
+  uint32_t m_row = 0; // of m_start, for error messages
+
+  AST m_ast;
+
+public:
+  StreamParser(std::istream &stream, SymbolTable &symbols, size_t blockSize = BLOCK_SIZE);
+
+  StreamParser(const StreamParser &) = delete;
+  StreamParser &operator =(const StreamParser &) = delete;
+
+  // Parses until the stream ends and returns the number of statements.
+  // A statement with syntax errors is not passed on; parsing carries on after
+  // it, as the parser recovers.
+  size_t operator ()(const Statement &statement, const Error &error);
+
+private:
+  void refill();
+};
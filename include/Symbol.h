@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Interned name. Two symbols from the same SymbolTable are equal exactly when
+// their names are, so they compare and hash as plain integers. A value-
+// initialized Symbol{} is NONE, and the type stays trivial so it can sit in
+// flat AST nodes.
+struct Symbol {
+  static constexpr uint32_t NONE = 0;
+
+  uint32_t id;
+
+  inline bool operator !() const {
+    return id == NONE;
+  }
+  friend inline bool operator ==(Symbol lhs, Symbol rhs) {
+    return lhs.id == rhs.id;
+  }
+};
+
+template<>
+struct std::hash<Symbol> {
+  size_t operator ()(Symbol symbol) const noexcept {
+    return symbol.id;
+  }
+};
+
+// Per-compilation-unit interner. Names are copied once into chunked storage
+// that never moves, so the views handed out stay valid for the table's life.
+class SymbolTable {
+private:
+  static constexpr size_t CHUNK_SIZE = 16 * 1024;
+
+  std::unordered_map<std::string_view, uint32_t> m_ids;
+  std::vector<std::string_view> m_names;
+  std::vector<std::unique_ptr<char[]>> m_chunks;
+  char *m_chunk = nullptr;
+  size_t m_chunkUsed = 0;
+
+public:
+  SymbolTable();
+  SymbolTable(const SymbolTable &) = delete;
+  SymbolTable &operator =(const SymbolTable &) = delete;
+  SymbolTable(SymbolTable &&) = default;
+  SymbolTable &operator =(SymbolTable &&) = default;
+
+  Symbol intern(std::string_view name);
+  Symbol find(std::string_view name) const;
+  // Forgets every name, keeping the hash table's buckets and the chunk
+  // being filled for the names interned next.
+  void clear();
+
+  inline std::string_view name(Symbol symbol) const {
+    return m_names[symbol.id];
+  }
+  // Every symbol id is below size(); id 0 is the reserved NONE slot.
+  inline size_t size() const {
+    return m_names.size();
+  }
+
+private:
+  std::string_view store(std::string_view name);
+};
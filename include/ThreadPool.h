@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of workers, each with its own task deque. A worker pops from the
+// front of its own deque and, when that runs dry, steals from the back of
+// the others', so uneven task sizes still keep every core busy.
+class ThreadPool {
+public:
+  // Receives the index of the worker running it, for worker-local state.
+  using Task = std::function<void(unsigned)>;
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  std::vector<std::unique_ptr<Queue>> m_queues;
+  std::vector<std::thread> m_workers;
+
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_idle;
+  size_t m_pending = 0;
+  bool m_stopping = false;
+  std::atomic<unsigned> m_next = 0;
+
+public:
+  // 0 threads means one per hardware thread.
+  explicit ThreadPool(unsigned threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator =(const ThreadPool &) = delete;
+
+  inline unsigned size() const {
+    return static_cast<unsigned>(m_workers.size());
+  }
+
+  void submit(Task task);
+
+  // Blocks until every submitted task has finished.
+  void wait();
+
+private:
+  void run(unsigned worker);
+  bool take(unsigned worker, Task &task);
+};
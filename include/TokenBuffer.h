@@ -0,0 +1,139 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "Lexer.h"
+
+// Tokens stored column-wise, so scanning kinds or ids touches only those
+// arrays. Values are not copied: offset/length point back into the lexer's
+// source, and value() has the lexer decode escaped STRING/CHAR tokens.
+class TokenBuffer {
+private:
+  const Lexer *m_lexer = nullptr;
+
+  std::vector<TokenType> m_types;
+  std::vector<uint32_t> m_ids;
+  std::vector<uint32_t> m_offsets;
+  std::vector<uint32_t> m_lengths;
+
+public:
+  void attach(const Lexer &lexer);
+  void push(const Token &tok);
+  void reserve(size_t count);
+  void clear();
+
+  // Drops the first `count` tokens.
+  void erase(size_t count);
+
+  inline size_t size() const {
+    return m_types.size();
+  }
+
+  inline const TokenType &type(size_t i) const {
+    return m_types[i];
+  }
+  inline const uint32_t &id(size_t i) const {
+    return m_ids[i];
+  }
+  inline const uint32_t &offset(size_t i) const {
+    return m_offsets[i];
+  }
+  inline const uint32_t &length(size_t i) const {
+    return m_lengths[i];
+  }
+  // Offset of the token's first character, opening quote included.
+  inline uint32_t start(size_t i) const {
+    return m_types[i] == TokenType::STRING || m_types[i] == TokenType::CHAR ? m_offsets[i] - 1 : m_offsets[i];
+  }
+
+  std::string_view value(size_t i) const;
+  // Of an INTEGER or FLOAT token whose id is not one of number::.
+  inline Number number(size_t i) const {
+    return m_lexer->number(m_ids[i]);
+  }
+  Token token(size_t i) const;
+};
+
+enum class TokenMode {
+  ON_DEMAND, // pull tokens from the lexer as the parser looks at them
+  PRELEXED,  // lex the whole input up front
+  CHUNKED,   // lex the whole input up front, split across threads
+};
+
+// The parser's view of the token stream: the current token plus any number
+// of tokens of lookahead, each read straight out of a TokenBuffer.
+class TokenCursor {
+private:
+  Lexer &m_lexer;
+  TokenBuffer m_tokens;
+  TokenMode m_mode;
+  size_t m_pos = 0;
+  size_t m_released = 0; // tokens dropped by release()
+
+public:
+  TokenCursor(Lexer &lexer, TokenMode mode);
+
+  // Index into buffer() of the token `ahead` positions past the current
+  // one. Past the end of input this is the EOB token.
+  inline size_t index(size_t ahead = 0) {
+    size_t i = m_pos + ahead;
+    if (i >= m_tokens.size()) {
+      fill(i);
+      if (i >= m_tokens.size()) {
+        i = m_tokens.size() - 1;
+      }
+    }
+    return i;
+  }
+
+  inline const TokenType &type(size_t ahead = 0) {
+    return m_tokens.type(index(ahead));
+  }
+  inline const uint32_t &id(size_t ahead = 0) {
+    return m_tokens.id(index(ahead));
+  }
+  inline std::string_view value(size_t ahead = 0) {
+    return m_tokens.value(index(ahead));
+  }
+  inline Keyword keyword(size_t ahead = 0) {
+    size_t i = index(ahead);
+    return m_tokens.type(i) == TokenType::KEYWORD ? static_cast<Keyword>(m_tokens.id(i)) : Keyword::NONE;
+  }
+  inline Operator op(size_t ahead = 0) {
+    size_t i = index(ahead);
+    return m_tokens.type(i) == TokenType::OPERATOR ? static_cast<Operator>(m_tokens.id(i)) : Operator::NONE;
+  }
+  inline Symbol symbol(size_t ahead = 0) {
+    size_t i = index(ahead);
+    return m_tokens.type(i) == TokenType::IDENTIFIER ? Symbol{ m_tokens.id(i) } : Symbol{};
+  }
+  inline uint32_t start(size_t ahead = 0) {
+    return m_tokens.start(index(ahead));
+  }
+  inline Token token(size_t ahead = 0) {
+    return m_tokens.token(index(ahead));
+  }
+
+  inline void advance() {
+    if (m_tokens.type(index()) != TokenType::EOB) {
+      m_pos++;
+    }
+  }
+
+  inline const TokenBuffer &buffer() const {
+    return m_tokens;
+  }
+
+  // Forgets tokens already consumed; only on-demand cursors bother.
+  void release();
+
+  // Tokens read from the lexer so far, released ones included.
+  inline size_t lexed() const {
+    return m_released + m_tokens.size();
+  }
+
+private:
+  void fill(size_t i);
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+
+// Parser trace events. Build with SKWIRL_TRACE=1 (`make trace`) to record
+// them; otherwise TRACE() expands to nothing and its arguments are never
+// evaluated, so a normal build carries no trace code at all.
+#ifndef SKWIRL_TRACE
+#define SKWIRL_TRACE 0
+#endif
+
+namespace trace {
+  enum class Event : uint8_t {
+    STATEMENT,   // top-level statement starts at token
+    GROUP,       // parenthesised expression starts at token
+    PUNCTUATOR,  // punctuator `arg` expected at token
+    NODE,        // node created from token
+    OPERATOR,    // binary operator at token
+    FUNCTION,    // function definition named by token
+  };
+
+  // Events are kept in a fixed ring shared by all threads; once it is full
+  // the oldest are overwritten. Writers claim a slot with one fetch_add and
+  // publish it through its sequence number, so recording never blocks.
+  inline constexpr size_t CAPACITY = 1 << 16;
+
+  struct Record {
+    std::atomic<uint64_t> seq; // slot index + 1 once written
+    uint64_t time;             // steady clock, ns
+    uint32_t token;            // source offset of the token
+    uint32_t node;
+    uint16_t thread;
+    Event event;
+    char arg;
+  };
+
+#if SKWIRL_TRACE
+  void record(Event event, uint32_t token, uint32_t node, char arg = 0);
+
+  // Writes the buffered events oldest first, one per line:
+  //   +<ns since first> t<thread> <EVENT> tok=<offset> node=<id> [arg]
+  // Call it once the threads being traced are idle, e.g. after a run or
+  // from an error handler.
+  void dump(std::ostream &os);
+  void clear();
+#else
+  inline void dump(std::ostream &) { }
+  inline void clear() { }
+#endif
+} // namespace trace
+
+#if SKWIRL_TRACE
+#define TRACE(event, ...) ::trace::record(::trace::Event::event, __VA_ARGS__)
+#else
+#define TRACE(event, ...) ((void)0)
+#endif
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <ostream>
+#include <vector>
+
+#include "Bytecode.h"
+
+// Runs compiled programs. Every frame is a window onto one flat register
+// stack: a call's arguments already sit where the callee's registers begin,
+// so calling copies nothing, and the result comes back in the first of
+// them. Dispatch uses computed goto where the compiler supports it.
+class VM {
+private:
+  struct Frame {
+    const Function *function;
+    const Instr *ret;
+    Slot *base;
+  };
+
+  const Program &m_program;
+  std::ostream &m_out;
+  std::vector<Slot> m_stack;
+  std::vector<Frame> m_frames;
+  std::vector<Slot> m_globals;
+
+public:
+  static constexpr size_t STACK_SLOTS = 1 << 20;
+  static constexpr size_t MAX_FRAMES = 1 << 16;
+
+  // `print` writes to `out`.
+  VM(const Program &program, std::ostream &out);
+
+  // Runs the top-level statements; the result has the kind of
+  // program.functions[program.main].result. Globals start at zero on
+  // every run.
+  Slot run();
+
+private:
+  [[noreturn]] void error(const std::string &message, const Function &function, const Instr *pc) const;
+};
+
+void printValue(std::ostream &os, const Program &program, Slot value, ValueKind kind);
@@ -0,0 +1,262 @@
+#include "AST.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+std::string_view astTypeName(ASTType type) {
+  switch (type) {
+  case ASTType::NONE: return "NONE";
+  case ASTType::EOB: return "EOB";
+  case ASTType::NAME: return "NAME";
+  case ASTType::BOOL: return "BOOL";
+  case ASTType::INTEGER: return "INTEGER";
+  case ASTType::FLOAT: return "FLOAT";
+  case ASTType::STRING: return "STRING";
+  case ASTType::CHAR: return "CHAR";
+  case ASTType::PROG: return "PROG";
+  case ASTType::FUNCTION: return "FUNCTION";
+  case ASTType::CALL: return "CALL";
+  case ASTType::VAR: return "VAR";
+  case ASTType::BINARY: return "BINARY";
+  case ASTType::ASSIGN: return "ASSIGN";
+  case ASTType::IF: return "IF";
+  case ASTType::UNARY: return "UNARY";
+  }
+  return "?";
+}
+
+AST::AST(const AST &other) {
+  *this = other;
+}
+
+AST::AST(AST &&other) noexcept {
+  *this = std::move(other);
+}
+
+AST &AST::operator =(const AST &other) {
+  if (this == &other) {
+    return *this;
+  }
+  m_nodes = other.m_nodes;
+  m_lists = other.m_lists;
+  m_strings = other.m_strings;
+  m_root = other.m_root;
+  m_image = other.m_image;
+  m_nodeView = other.m_nodeView;
+  m_listView = other.m_listView;
+  m_stringView = other.m_stringView;
+  if (!m_image) {
+    sync();
+  }
+  return *this;
+}
+
+AST &AST::operator =(AST &&other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  m_nodes = std::move(other.m_nodes);
+  m_lists = std::move(other.m_lists);
+  m_strings = std::move(other.m_strings);
+  m_root = other.m_root;
+  m_image = std::move(other.m_image);
+  m_nodeView = other.m_nodeView;
+  m_listView = other.m_listView;
+  m_stringView = other.m_stringView;
+  if (!m_image) {
+    // A short string's bytes move with it, so its view must follow.
+    sync();
+  }
+  other.m_image.reset();
+  other.sync();
+  return *this;
+}
+
+NodeId AST::add(const ASTNode &node) {
+  if (m_image) {
+    thaw();
+  }
+  m_nodes.push_back(node);
+  m_nodeView = m_nodes;
+  return static_cast<NodeId>(m_nodes.size() - 1);
+}
+
+NodeList AST::addList(std::span<const NodeId> ids) {
+  if (m_image) {
+    thaw();
+  }
+  NodeList list{ static_cast<uint32_t>(m_lists.size()), static_cast<uint32_t>(ids.size()) };
+  m_lists.insert(m_lists.end(), ids.begin(), ids.end());
+  m_listView = m_lists;
+  return list;
+}
+
+NodeList AST::spliceList(NodeList list, uint32_t at, uint32_t count, std::span<const NodeId> ids) {
+  if (m_image) {
+    thaw();
+  }
+  auto old = m_lists.begin() + list.begin;
+  if (ids.size() == count) {
+    std::copy(ids.begin(), ids.end(), old + at);
+  } else if (list.begin + list.size == m_lists.size()) {
+    old = m_lists.erase(old + at, old + at + count);
+    m_lists.insert(old, ids.begin(), ids.end());
+  } else {
+    size_t end = m_lists.size();
+    m_lists.resize(end + list.size - count + ids.size());
+    old = m_lists.begin() + list.begin;
+    auto out = std::copy(old, old + at, m_lists.begin() + end);
+    out = std::copy(ids.begin(), ids.end(), out);
+    std::copy(old + at + count, old + list.size, out);
+    list.begin = static_cast<uint32_t>(end);
+  }
+  list.size = static_cast<uint32_t>(list.size - count + ids.size());
+  m_listView = m_lists;
+  return list;
+}
+
+StringRef AST::addString(std::string_view text) {
+  if (m_image) {
+    thaw();
+  }
+  StringRef ref{ static_cast<uint32_t>(m_strings.size()), static_cast<uint32_t>(text.size()) };
+  m_strings.append(text);
+  m_stringView = m_strings;
+  return ref;
+}
+
+void AST::adopt(std::shared_ptr<const void> image, std::span<const ASTNode> nodes, std::span<const NodeId> lists, std::string_view strings, NodeId root) {
+  m_nodes.clear();
+  m_lists.clear();
+  m_strings.clear();
+  m_image = std::move(image);
+  m_nodeView = nodes;
+  m_listView = lists;
+  m_stringView = strings;
+  m_root = root;
+}
+
+void AST::thaw() {
+  m_nodes.assign(m_nodeView.begin(), m_nodeView.end());
+  m_lists.assign(m_listView.begin(), m_listView.end());
+  m_strings.assign(m_stringView);
+  m_image.reset();
+  sync();
+}
+
+void AST::sync() {
+  m_nodeView = m_nodes;
+  m_listView = m_lists;
+  m_stringView = m_strings;
+}
+
+void AST::rewind(Mark mark) {
+  if (m_image) {
+    thaw();
+  }
+  m_nodes.resize(mark.nodes);
+  m_lists.resize(mark.lists);
+  m_strings.resize(mark.strings);
+  sync();
+}
+
+void AST::clear() {
+  m_nodes.clear();
+  m_lists.clear();
+  m_strings.clear();
+  m_image.reset();
+  sync();
+  m_root = NO_NODE;
+}
+
+std::ostream &operator <<(std::ostream &os, const AST &ast) {
+  return os << ast.ref();
+}
+
+const ASTNode &ASTRef::node() const {
+  return m_ast->node(m_id);
+}
+
+ASTType ASTRef::type() const {
+  return m_ast == nullptr || m_id == NO_NODE ? ASTType::NONE : node().type;
+}
+
+ASTRef::ValueType ASTRef::at(uint32_t id) const {
+  const ASTNode &n = node();
+  auto child = [this](NodeId child) -> ValueType {
+    if (child == NO_NODE) {
+      return nullptr;
+    }
+    return ASTRef(m_ast, child);
+  };
+  auto children = [this](NodeList list) -> ValueType {
+    std::vector<ASTRef> refs;
+    refs.reserve(list.size);
+    for (NodeId child : m_ast->list(list)) {
+      refs.emplace_back(m_ast, child);
+    }
+    return refs;
+  };
+
+  switch (n.type) {
+  case ASTType::NAME:
+    if (id == astid::VALUE) return n.name;
+    break;
+  case ASTType::BOOL:
+    if (id == astid::VALUE) return n.boolean;
+    break;
+  case ASTType::INTEGER:
+    if (id == astid::VALUE) return n.integer;
+    break;
+  case ASTType::FLOAT:
+    if (id == astid::VALUE) return n.real;
+    break;
+  case ASTType::STRING:
+    if (id == astid::VALUE) return m_ast->string(n.string);
+    break;
+  case ASTType::CHAR:
+    if (id == astid::VALUE) return n.character;
+    break;
+  case ASTType::PROG:
+    if (id == astid::PROG) return children(n.prog.body);
+    break;
+  case ASTType::FUNCTION:
+    if (id == astid::FUNCTION_NAME) return n.function.name;
+    if (id == astid::FUNCTION_PARAMS) return children(n.function.params);
+    if (id == astid::FUNCTION_BODY) return child(n.function.body);
+    if (id == astid::FUNCTION_RETTYPE) return n.function.retType;
+    break;
+  case ASTType::CALL:
+    if (id == astid::CALL_FUNC) return child(n.call.func);
+    if (id == astid::CALL_ARGS) return children(n.call.args);
+    break;
+  case ASTType::VAR:
+    if (id == astid::VAR_NAME) return n.var.name;
+    if (id == astid::VAR_TYPE) return n.var.type;
+    if (id == astid::VAR_INITVAL) return child(n.var.init);
+    break;
+  case ASTType::BINARY:
+  case ASTType::ASSIGN:
+    if (id == astid::BINARY_OP) return operatorName(n.binary.op);
+    if (id == astid::BINARY_LEFT) return child(n.binary.left);
+    if (id == astid::BINARY_RIGHT) return child(n.binary.right);
+    break;
+  case ASTType::UNARY:
+    if (id == astid::UNARY_OP) return operatorName(n.unary.op);
+    if (id == astid::UNARY_OPERAND) return child(n.unary.operand);
+    break;
+  case ASTType::IF:
+    if (id == astid::IF_COND) return child(n.if_.cond);
+    if (id == astid::IF_THEN) return child(n.if_.then);
+    if (id == astid::IF_ELSE) return child(n.if_.else_);
+    break;
+  default:
+    break;
+  }
+  throw std::out_of_range("AST node " + std::string(astTypeName(n.type)) + " has no value " + std::to_string(id));
+}
+
+std::ostream &operator <<(std::ostream &os, const ASTRef &ref) {
+  os << astTypeName(ref.type());
+  return os;
+}
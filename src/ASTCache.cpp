@@ -0,0 +1,324 @@
+#include "ASTCache.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Hash.h"
+#include "Source.h"
+
+// File layout, every section starting on an 8-byte boundary:
+//
+//   Header
+//   ASTNode  nodes[nodeCount]
+//   NodeId   lists[listCount]
+//   uint32_t symbolOffsets[symbolCount + 1]   names of symbols 1..symbolCount
+//   char     symbolBytes[symbolOffsets[symbolCount]]
+//   char     strings[stringBytes]
+//
+// The checksum covers the header (with the checksum field zeroed) and then
+// everything after it, so truncation, bit rot and half-written files all
+// fail the load. It does not show that the file was written by this code,
+// so every index in the nodes is checked against the sections before the
+// tree is used.
+
+static_assert(std::is_trivially_copyable_v<ASTNode>, "ASTNode is stored as raw bytes");
+
+namespace {
+  constexpr char MAGIC[8] = { 'S', 'K', 'W', 'A', 'S', 'T', '\0', '\0' };
+  constexpr uint32_t ENDIAN_MARK = 0x01020304;
+  constexpr size_t ALIGN = 8;
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t endianMark;
+    uint32_t nodeSize;
+    uint32_t root;
+    uint64_t sourceHash;
+    uint64_t sourceSize;
+    uint32_t nodeCount;
+    uint32_t listCount;
+    uint32_t symbolCount;
+    uint32_t symbolBytes;
+    uint32_t stringBytes;
+    uint32_t reserved;
+    uint64_t checksum;
+  };
+  static_assert(sizeof(Header) % ALIGN == 0);
+  static_assert(alignof(ASTNode) <= ALIGN);
+
+  struct Layout {
+    uint64_t nodes;
+    uint64_t lists;
+    uint64_t symbolOffsets;
+    uint64_t symbolBytes;
+    uint64_t strings;
+    uint64_t size;
+  };
+
+  constexpr uint64_t align(uint64_t offset) {
+    return (offset + ALIGN - 1) & ~(ALIGN - 1);
+  }
+
+  // Counts are 32-bit and sums are 64-bit, so no header can overflow this.
+  Layout layoutOf(const Header &header) {
+    Layout layout;
+    layout.nodes = align(sizeof(Header));
+    layout.lists = align(layout.nodes + uint64_t(header.nodeCount) * sizeof(ASTNode));
+    layout.symbolOffsets = align(layout.lists + uint64_t(header.listCount) * sizeof(NodeId));
+    layout.symbolBytes = layout.symbolOffsets + (uint64_t(header.symbolCount) + 1) * sizeof(uint32_t);
+    layout.strings = layout.symbolBytes + header.symbolBytes;
+    layout.size = layout.strings + header.stringBytes;
+    return layout;
+  }
+
+  uint64_t checksumOf(Header header, std::string_view payload) {
+    header.checksum = 0;
+    uint64_t seed = hashBytes(std::string_view(reinterpret_cast<const char *>(&header), sizeof(header)));
+    return hashBytes(payload, seed);
+  }
+
+  // Whether every child id, list range, symbol id and string range in the
+  // nodes stays inside the image, and every node is the child of at most one
+  // other and the root of none: what hangs from the root is then a tree.
+  bool checkNodes(const Header &header, std::span<const ASTNode> nodes, std::span<const NodeId> lists) {
+    std::vector<bool> owned(nodes.size());
+    auto child = [&](NodeId id, bool optional) {
+      if (id == NO_NODE) {
+        return optional;
+      }
+      if (id >= nodes.size() || owned[id]) {
+        return false;
+      }
+      owned[id] = true;
+      return true;
+    };
+    auto children = [&](NodeList list) {
+      if (uint64_t(list.begin) + list.size > lists.size()) {
+        return false;
+      }
+      for (NodeId id : lists.subspan(list.begin, list.size)) {
+        if (!child(id, false)) {
+          return false;
+        }
+      }
+      return true;
+    };
+    auto symbol = [&](Symbol symbol) {
+      return symbol.id <= header.symbolCount;
+    };
+    auto op = [](Operator op) {
+      return op <= Operator::NOT;
+    };
+
+    for (const ASTNode &node : nodes) {
+      bool ok;
+      switch (node.type) {
+      case ASTType::NAME:
+        ok = symbol(node.name);
+        break;
+      case ASTType::STRING:
+        ok = uint64_t(node.string.offset) + node.string.size <= header.stringBytes;
+        break;
+      case ASTType::PROG:
+        ok = children(node.prog.body);
+        break;
+      case ASTType::FUNCTION:
+        ok = symbol(node.function.name) && symbol(node.function.retType)
+          && children(node.function.params) && child(node.function.body, false);
+        break;
+      case ASTType::CALL:
+        ok = child(node.call.func, false) && children(node.call.args);
+        break;
+      case ASTType::VAR:
+        ok = symbol(node.var.name) && symbol(node.var.type) && child(node.var.init, true);
+        break;
+      case ASTType::BINARY:
+      case ASTType::ASSIGN:
+        ok = op(node.binary.op) && child(node.binary.left, false) && child(node.binary.right, false);
+        break;
+      case ASTType::UNARY:
+        ok = op(node.unary.op) && child(node.unary.operand, false);
+        break;
+      case ASTType::IF:
+        ok = child(node.if_.cond, false) && child(node.if_.then, false) && child(node.if_.else_, true);
+        break;
+      default:
+        ok = node.type <= ASTType::UNARY;
+        break;
+      }
+      if (!ok) {
+        return false;
+      }
+    }
+    return header.root == NO_NODE || !owned[header.root];
+  }
+
+  // Rewrites every Symbol in the tree through `ids`, for a table that
+  // already held other names when the file was loaded.
+  void remapSymbols(AST &ast, const std::vector<uint32_t> &ids) {
+    for (NodeId id = 0; id < ast.size(); id++) {
+      ASTNode &node = ast.node(id);
+      switch (node.type) {
+      case ASTType::NAME:
+        node.name.id = ids[node.name.id];
+        break;
+      case ASTType::FUNCTION:
+        node.function.name.id = ids[node.function.name.id];
+        node.function.retType.id = ids[node.function.retType.id];
+        break;
+      case ASTType::VAR:
+        node.var.name.id = ids[node.var.name.id];
+        node.var.type.id = ids[node.var.type.id];
+        break;
+      default:
+        break;
+      }
+    }
+  }
+} // namespace
+
+ASTCache::ASTCache(std::string dir) : m_dir(std::move(dir)) { }
+
+ASTCache::Key ASTCache::keyOf(std::string_view source) {
+  return Key{ hashBytes(source), source.size() };
+}
+
+std::string ASTCache::path(Key key) const {
+  char name[24];
+  std::snprintf(name, sizeof(name), "%016llx.ast", static_cast<unsigned long long>(key.hash));
+  return m_dir + "/" + name;
+}
+
+bool ASTCache::load(Key key, SymbolTable &symbols, AST &ast) const {
+  auto image = std::make_shared<Source>();
+  try {
+    *image = Source::mapFile(path(key));
+  } catch (const std::runtime_error &) {
+    return false;
+  }
+
+  Header header;
+  if (image->size() < sizeof(Header)) {
+    return false;
+  }
+  std::memcpy(&header, image->data(), sizeof(Header));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+      || header.version != VERSION
+      || header.endianMark != ENDIAN_MARK
+      || header.nodeSize != sizeof(ASTNode)
+      || header.sourceHash != key.hash
+      || header.sourceSize != key.size) {
+    return false;
+  }
+  Layout layout = layoutOf(header);
+  if (layout.size != image->size()) {
+    return false;
+  }
+  std::string_view payload = image->view().substr(sizeof(Header));
+  if (checksumOf(header, payload) != header.checksum) {
+    return false;
+  }
+  if (header.root != NO_NODE && header.root >= header.nodeCount) {
+    return false;
+  }
+
+  const char *base = image->data();
+  auto offsets = reinterpret_cast<const uint32_t *>(base + layout.symbolOffsets);
+  for (uint32_t i = 0; i < header.symbolCount; i++) {
+    if (offsets[i] > offsets[i + 1] || offsets[i + 1] > header.symbolBytes) {
+      return false;
+    }
+  }
+  std::span<const ASTNode> nodes(reinterpret_cast<const ASTNode *>(base + layout.nodes), header.nodeCount);
+  std::span<const NodeId> lists(reinterpret_cast<const NodeId *>(base + layout.lists), header.listCount);
+  if (!checkNodes(header, nodes, lists)) {
+    return false;
+  }
+
+  // A fresh table hands out the same ids the file was written with, so the
+  // nodes can be used as they are.
+  std::vector<uint32_t> ids(header.symbolCount + 1);
+  bool same = true;
+  for (uint32_t i = 0; i < header.symbolCount; i++) {
+    std::string_view name(base + layout.symbolBytes + offsets[i], offsets[i + 1] - offsets[i]);
+    ids[i + 1] = symbols.intern(name).id;
+    same = same && ids[i + 1] == i + 1;
+  }
+
+  ast.adopt(image, nodes, lists, std::string_view(base + layout.strings, header.stringBytes), header.root);
+  if (!same) {
+    remapSymbols(ast, ids);
+  }
+  return true;
+}
+
+void ASTCache::store(Key key, const SymbolTable &symbols, const AST &ast) const {
+  Header header{};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.endianMark = ENDIAN_MARK;
+  header.nodeSize = sizeof(ASTNode);
+  header.root = ast.root();
+  header.sourceHash = key.hash;
+  header.sourceSize = key.size;
+  header.nodeCount = static_cast<uint32_t>(ast.nodes().size());
+  header.listCount = static_cast<uint32_t>(ast.lists().size());
+  header.symbolCount = static_cast<uint32_t>(symbols.size() - 1);
+  header.stringBytes = static_cast<uint32_t>(ast.strings().size());
+
+  std::vector<uint32_t> offsets{ 0 };
+  for (uint32_t id = 1; id < symbols.size(); id++) {
+    offsets.push_back(offsets.back() + static_cast<uint32_t>(symbols.name(Symbol{ id }).size()));
+  }
+  header.symbolBytes = offsets.back();
+
+  Layout layout = layoutOf(header);
+  std::string file(layout.size, '\0');
+  char *base = file.data();
+  std::memcpy(base + layout.nodes, ast.nodes().data(), ast.nodes().size_bytes());
+  std::memcpy(base + layout.lists, ast.lists().data(), ast.lists().size_bytes());
+  std::memcpy(base + layout.symbolOffsets, offsets.data(), offsets.size() * sizeof(uint32_t));
+  for (uint32_t id = 1; id < symbols.size(); id++) {
+    auto name = symbols.name(Symbol{ id });
+    std::memcpy(base + layout.symbolBytes + offsets[id - 1], name.data(), name.size());
+  }
+  std::memcpy(base + layout.strings, ast.strings().data(), ast.strings().size());
+  header.checksum = checksumOf(header, std::string_view(file).substr(sizeof(Header)));
+  std::memcpy(base, &header, sizeof(Header));
+
+  if (::mkdir(m_dir.c_str(), 0777) != 0 && errno != EEXIST) {
+    throw std::runtime_error("Cannot create '" + m_dir + "': " + std::strerror(errno));
+  }
+
+  // Written under a name of its own and renamed into place, so concurrent
+  // writers and readers only ever see whole files.
+  static std::atomic<uint64_t> serial = 0;
+  std::string target = path(key);
+  std::string temp = target + "." + std::to_string(::getpid()) + "." + std::to_string(serial++) + ".tmp";
+  {
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    out.write(file.data(), static_cast<std::streamsize>(file.size()));
+    if (!out.flush()) {
+      out.close();
+      std::remove(temp.c_str());
+      throw std::runtime_error("Cannot write '" + temp + "'");
+    }
+  }
+  if (std::rename(temp.c_str(), target.c_str()) != 0) {
+    int err = errno;
+    std::remove(temp.c_str());
+    throw std::runtime_error("Cannot rename '" + temp + "': " + std::strerror(err));
+  }
+}
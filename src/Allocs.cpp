@@ -0,0 +1,165 @@
+#include "Allocs.h"
+
+#include <charconv>
+#include <iomanip>
+
+namespace allocs {
+  namespace {
+    constexpr std::string_view SITE_NAMES[SITES] = {
+      "other", "lexer", "statement", "atom", "call", "binary", "list", "function", "fold", "resolve", "compile", "run",
+    };
+
+    template <typename T>
+    bool parseNumber(std::string_view text, T &value) {
+      auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+      return ec == std::errc() && end == text.data() + text.size();
+    }
+
+    double ratio(uint64_t count, uint64_t per) {
+      return per == 0 ? 0 : static_cast<double>(count) / per;
+    }
+  } // namespace
+
+  std::string_view siteName(Site site) {
+    return SITE_NAMES[static_cast<size_t>(site)];
+  }
+
+  bool Budget::parse(std::string_view spec) {
+    size_t eq = spec.find('=');
+    if (eq == std::string_view::npos) {
+      return false;
+    }
+    std::string_view key = spec.substr(0, eq), value = spec.substr(eq + 1);
+    if (key == "per-token") {
+      return parseNumber(value, perToken);
+    } else if (key == "per-node") {
+      return parseNumber(value, perNode);
+    } else if (key == "bytes") {
+      return parseNumber(value, bytes);
+    } else if (key == "peak") {
+      return parseNumber(value, peakLive);
+    }
+    return false;
+  }
+
+  void print(std::ostream &os, const Totals &totals, uint64_t tokens, uint64_t nodes) {
+    os << "allocations: " << totals.all.allocations << " (" << std::fixed << std::setprecision(3)
+       << ratio(totals.all.allocations, tokens) << " per token, " << ratio(totals.all.allocations, nodes)
+       << " per node), " << totals.all.bytes << " bytes, " << totals.frees << " frees, peak live "
+       << totals.peakLive << " bytes\n" << std::defaultfloat;
+    for (size_t s = 0; s < SITES; s++) {
+      const Counts &site = totals.sites[s];
+      if (site.allocations == 0) {
+        continue;
+      }
+      os << "  " << std::left << std::setw(10) << SITE_NAMES[s] << std::right << std::setw(12)
+         << site.allocations << std::setw(15) << site.bytes << " bytes\n";
+    }
+  }
+
+  bool exceeds(std::ostream &os, const Totals &totals, uint64_t tokens, uint64_t nodes, const Budget &budget) {
+    bool over = false;
+    auto check = [&](bool broken, std::string_view what, auto actual, auto limit) {
+      if (broken) {
+        os << "allocation budget exceeded: " << what << ' ' << actual << " > " << limit << '\n';
+        over = true;
+      }
+    };
+    double perToken = ratio(totals.all.allocations, tokens);
+    double perNode = ratio(totals.all.allocations, nodes);
+    check(perToken > budget.perToken, "per-token", perToken, budget.perToken);
+    check(perNode > budget.perNode, "per-node", perNode, budget.perNode);
+    check(totals.all.bytes > budget.bytes, "bytes", totals.all.bytes, budget.bytes);
+    check(totals.peakLive > budget.peakLive, "peak", totals.peakLive, budget.peakLive);
+    return over;
+  }
+} // namespace allocs
+
+#if SKWIRL_ALLOCS
+
+#include <malloc.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace allocs {
+  namespace {
+    struct AtomicCounts {
+      std::atomic<uint64_t> allocations = 0;
+      std::atomic<uint64_t> bytes = 0;
+    };
+
+    AtomicCounts SITE_COUNTS[SITES];
+    std::atomic<uint64_t> FREES = 0;
+    // Usable sizes, so that a free subtracts exactly what its allocation
+    // added without a header to remember it by.
+    std::atomic<int64_t> LIVE = 0;
+    std::atomic<int64_t> PEAK = 0;
+
+    thread_local Site SITE = Site::OTHER;
+  } // namespace
+
+  Scope::Scope(Site site) : m_previous(SITE) {
+    SITE = site;
+  }
+
+  Scope::~Scope() {
+    SITE = m_previous;
+  }
+
+  Totals totals() {
+    Totals totals;
+    for (size_t s = 0; s < SITES; s++) {
+      totals.sites[s].allocations = SITE_COUNTS[s].allocations.load(std::memory_order_relaxed);
+      totals.sites[s].bytes = SITE_COUNTS[s].bytes.load(std::memory_order_relaxed);
+      totals.all.allocations += totals.sites[s].allocations;
+      totals.all.bytes += totals.sites[s].bytes;
+    }
+    totals.frees = FREES.load(std::memory_order_relaxed);
+    totals.peakLive = static_cast<uint64_t>(PEAK.load(std::memory_order_relaxed));
+    return totals;
+  }
+
+  void reset() {
+    for (auto &site : SITE_COUNTS) {
+      site.allocations.store(0, std::memory_order_relaxed);
+      site.bytes.store(0, std::memory_order_relaxed);
+    }
+    FREES.store(0, std::memory_order_relaxed);
+    PEAK.store(LIVE.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+} // namespace allocs
+
+// The array, nothrow and sized forms forward to these by default. Aligned
+// allocations bypass them and go uncounted.
+void *operator new(size_t size) {
+  void *p = std::malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  using namespace allocs;
+  auto &site = SITE_COUNTS[static_cast<size_t>(SITE)];
+  site.allocations.fetch_add(1, std::memory_order_relaxed);
+  site.bytes.fetch_add(size, std::memory_order_relaxed);
+  int64_t usable = static_cast<int64_t>(malloc_usable_size(p));
+  int64_t live = LIVE.fetch_add(usable, std::memory_order_relaxed) + usable;
+  int64_t peak = PEAK.load(std::memory_order_relaxed);
+  while (live > peak && !PEAK.compare_exchange_weak(peak, live, std::memory_order_relaxed)) { }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  if (p == nullptr) {
+    return;
+  }
+  allocs::FREES.fetch_add(1, std::memory_order_relaxed);
+  allocs::LIVE.fetch_sub(static_cast<int64_t>(malloc_usable_size(p)), std::memory_order_relaxed);
+  std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+  operator delete(p);
+}
+
+#endif
@@ -0,0 +1,82 @@
+#include "Bytecode.h"
+
+#include <iomanip>
+
+std::string_view valueKindName(ValueKind kind) {
+  switch (kind) {
+  case ValueKind::INT: return "int";
+  case ValueKind::FLOAT: return "float";
+  case ValueKind::BOOL: return "bool";
+  case ValueKind::CHAR: return "char";
+  case ValueKind::STRING: return "string";
+  }
+  return "?";
+}
+
+std::string_view opCodeName(OpCode op) {
+  static constexpr std::string_view NAMES[] = {
+    #define SKWIRL_OPCODE_NAME(name) #name,
+    SKWIRL_OPCODES(SKWIRL_OPCODE_NAME)
+    #undef SKWIRL_OPCODE_NAME
+  };
+  auto i = static_cast<size_t>(op);
+  return i < std::size(NAMES) ? NAMES[i] : "?";
+}
+
+std::ostream &operator <<(std::ostream &os, const Program &program) {
+  for (size_t f = 0; f < program.functions.size(); f++) {
+    const Function &fn = program.functions[f];
+    os << "function " << f << " " << fn.name << "(";
+    for (size_t i = 0; i < fn.params.size(); i++) {
+      os << (i > 0 ? ", " : "") << valueKindName(fn.params[i]);
+    }
+    os << ") as " << valueKindName(fn.result) << ", " << fn.registers << " registers\n";
+
+    for (size_t pc = 0; pc < fn.code.size(); pc++) {
+      const Instr &ins = fn.code[pc];
+      os << "  " << std::setw(5) << pc << "  " << std::left << std::setw(7) << opCodeName(ins.op) << std::right;
+      switch (ins.op) {
+      case OpCode::LOADI:
+        os << "r" << +ins.a << " " << ins.sbx();
+        break;
+      case OpCode::LOADK:
+        os << "r" << +ins.a << " k" << ins.bx() << " (" << program.constants[ins.bx()].i << ")";
+        break;
+      case OpCode::LOADG:
+      case OpCode::STOREG:
+        os << "r" << +ins.a << " g" << ins.bx();
+        break;
+      case OpCode::CALL:
+        os << "r" << +ins.a << " " << program.functions[ins.bx()].name;
+        break;
+      case OpCode::JMP:
+        os << "-> " << pc + 1 + ins.sbx();
+        break;
+      case OpCode::JMPF:
+      case OpCode::JMPT:
+        os << "r" << +ins.a << " -> " << pc + 1 + ins.sbx();
+        break;
+      case OpCode::RET:
+        os << "r" << +ins.a;
+        break;
+      case OpCode::PRINT:
+        os << "r" << +ins.a << " " << valueKindName(static_cast<ValueKind>(ins.b)) << (ins.c ? " \\n" : "");
+        break;
+      case OpCode::MOVE:
+      case OpCode::NEGI:
+      case OpCode::NEGF:
+      case OpCode::NOT:
+      case OpCode::TESTI:
+      case OpCode::TESTF:
+      case OpCode::I2F:
+        os << "r" << +ins.a << " r" << +ins.b;
+        break;
+      default:
+        os << "r" << +ins.a << " r" << +ins.b << " r" << +ins.c;
+        break;
+      }
+      os << "\n";
+    }
+  }
+  return os;
+}
@@ -1,58 +1,196 @@
 #include "Chars.h"
 
-using namespace std::literals;
-
-bool strchr(const char *str, char c) {
-  const char *s = str;
-  while (*s != '\0') {
-    if (c == *s)
-      return true;
-    
-    ++s;
+#if defined(__x86_64__)
+#define SKWIRL_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace {
+
+using ScanFunction = const char *(*)(const char *, const char *);
+
+struct ScanKernels {
+  ScanFunction whitespace;
+  ScanFunction identifier;
+  ScanFunction line;
+  ScanFunction string;
+  ScanFunction character;
+};
+
+const char *scanClassScalar(const char *p, const char *end, uint8_t cls) {
+  while (p != end && hasCharClass(*p, cls)) {
+    ++p;
   }
-  return false;
+  return p;
 }
 
-bool isWhitespace(const char *c) {
-  return *c == ' ' || *c == '\t' || *c == '\r' || *c == '\v' || *c == '\f';
+const char *scanWhitespaceScalar(const char *p, const char *end) {
+  return scanClassScalar(p, end, charclass::WHITESPACE);
 }
 
-bool isIdentifier(const char *c) {
-  return (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9') || *c == '_';
+const char *scanIdentifierScalar(const char *p, const char *end) {
+  return scanClassScalar(p, end, charclass::IDENTIFIER);
 }
 
-std::string KEYWORDS[] = {
-  "let"s, "as"s, "const"s, "define"s, "begin"s, "do"s, "end"s, "if"s, "then"s, "else"s, ""s
-};
-bool isKeyword(const char *c) {
-  std::string *keywords = KEYWORDS;
-  while (!keywords->empty()) {
-    if (*keywords == c) {
-      return true;
-    }
-    keywords++;
+const char *scanLineScalar(const char *p, const char *end) {
+  while (p != end && *p != '\n') {
+    ++p;
+  }
+  return p;
+}
+
+template <char QUOTE>
+const char *scanLiteralScalar(const char *p, const char *end) {
+  while (p != end && *p != QUOTE && *p != '\\') {
+    ++p;
+  }
+  return p;
+}
+
+const char *scanStringScalar(const char *p, const char *end) {
+  return scanLiteralScalar<'"'>(p, end);
+}
+
+const char *scanCharScalar(const char *p, const char *end) {
+  return scanLiteralScalar<'\''>(p, end);
+}
+
+#ifdef SKWIRL_X86_KERNELS
+
+// Lanes are classified with unsigned range checks: (x - lo) <= (hi - lo)
+// holds exactly when min(x - lo, hi - lo) == x - lo.
+
+inline __m128i inRange128(__m128i x, char lo, char hi) {
+  __m128i t = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(hi - lo)), t);
+}
+
+inline __m128i whitespace128(__m128i x) {
+  // ' ' plus '\t'..'\r' without '\n'
+  __m128i ws = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(' ')), inRange128(x, '\t', '\r'));
+  return _mm_andnot_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')), ws);
+}
+
+inline __m128i identifier128(__m128i x) {
+  __m128i alpha = inRange128(_mm_or_si128(x, _mm_set1_epi8(0x20)), 'a', 'z');
+  __m128i digit = inRange128(x, '0', '9');
+  __m128i under = _mm_cmpeq_epi8(x, _mm_set1_epi8('_'));
+  return _mm_or_si128(_mm_or_si128(alpha, digit), under);
+}
+
+inline __m128i notNewline128(__m128i x) {
+  return _mm_xor_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8('\n')), _mm_set1_epi8(-1));
+}
+
+template <char QUOTE>
+inline __m128i literal128(__m128i x) {
+  __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(x, _mm_set1_epi8(QUOTE)), _mm_cmpeq_epi8(x, _mm_set1_epi8('\\')));
+  return _mm_xor_si128(stop, _mm_set1_epi8(-1));
+}
+
+#define SCAN_SSE2(name, classify, tail) \
+  const char *name(const char *p, const char *end) { \
+    while (end - p >= 16) { \
+      __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); \
+      unsigned miss = ~static_cast<unsigned>(_mm_movemask_epi8(classify(x))) & 0xFFFFu; \
+      if (miss != 0) { \
+        return p + __builtin_ctz(miss); \
+      } \
+      p += 16; \
+    } \
+    return tail(p, end); \
   }
-  return false;
+
+SCAN_SSE2(scanWhitespaceSSE2, whitespace128, scanWhitespaceScalar)
+SCAN_SSE2(scanIdentifierSSE2, identifier128, scanIdentifierScalar)
+SCAN_SSE2(scanLineSSE2, notNewline128, scanLineScalar)
+SCAN_SSE2(scanStringSSE2, literal128<'"'>, scanStringScalar)
+SCAN_SSE2(scanCharSSE2, literal128<'\''>, scanCharScalar)
+
+#undef SCAN_SSE2
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 inline __m256i inRange256(__m256i x, char lo, char hi) {
+  __m256i t = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(t, _mm256_set1_epi8(hi - lo)), t);
 }
 
-bool isDigit(const char *c) {
-  return *c >= '0' && *c <= '9';
+AVX2 inline __m256i whitespace256(__m256i x) {
+  __m256i ws = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(' ')), inRange256(x, '\t', '\r'));
+  return _mm256_andnot_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')), ws);
 }
 
-bool isStringQuote(const char *c) {
-  return *c == '"';
+AVX2 inline __m256i identifier256(__m256i x) {
+  __m256i alpha = inRange256(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), 'a', 'z');
+  __m256i digit = inRange256(x, '0', '9');
+  __m256i under = _mm256_cmpeq_epi8(x, _mm256_set1_epi8('_'));
+  return _mm256_or_si256(_mm256_or_si256(alpha, digit), under);
 }
 
-bool isCharQuote(const char *c) {
-  return *c == '\'';
+AVX2 inline __m256i notNewline256(__m256i x) {
+  return _mm256_xor_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8('\n')), _mm256_set1_epi8(-1));
 }
 
-const char *OPERATORS = "+-*/%&|^~!?:=<>";
-bool isOperator(const char *c) {
-  return strchr(OPERATORS, *c);
+template <char QUOTE>
+AVX2 inline __m256i literal256(__m256i x) {
+  __m256i stop = _mm256_or_si256(_mm256_cmpeq_epi8(x, _mm256_set1_epi8(QUOTE)), _mm256_cmpeq_epi8(x, _mm256_set1_epi8('\\')));
+  return _mm256_xor_si256(stop, _mm256_set1_epi8(-1));
 }
 
-const char *PUNCTUATORS = ".,;()[]{}\n";
-bool isPunctuator(const char *c) {
-  return strchr(PUNCTUATORS, *c);
-}
\ No newline at end of file
+#define SCAN_AVX2(name, classify, tail) \
+  AVX2 const char *name(const char *p, const char *end) { \
+    while (end - p >= 32) { \
+      __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); \
+      unsigned miss = ~static_cast<unsigned>(_mm256_movemask_epi8(classify(x))); \
+      if (miss != 0) { \
+        return p + __builtin_ctz(miss); \
+      } \
+      p += 32; \
+    } \
+    return tail(p, end); \
+  }
+
+SCAN_AVX2(scanWhitespaceAVX2, whitespace256, scanWhitespaceSSE2)
+SCAN_AVX2(scanIdentifierAVX2, identifier256, scanIdentifierSSE2)
+SCAN_AVX2(scanLineAVX2, notNewline256, scanLineSSE2)
+SCAN_AVX2(scanStringAVX2, literal256<'"'>, scanStringSSE2)
+SCAN_AVX2(scanCharAVX2, literal256<'\''>, scanCharSSE2)
+
+#undef SCAN_AVX2
+#undef AVX2
+
+#endif // SKWIRL_X86_KERNELS
+
+ScanKernels selectKernels() {
+#ifdef SKWIRL_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return { &scanWhitespaceAVX2, &scanIdentifierAVX2, &scanLineAVX2, &scanStringAVX2, &scanCharAVX2 };
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return { &scanWhitespaceSSE2, &scanIdentifierSSE2, &scanLineSSE2, &scanStringSSE2, &scanCharSSE2 };
+  }
+#endif
+  return { &scanWhitespaceScalar, &scanIdentifierScalar, &scanLineScalar, &scanStringScalar, &scanCharScalar };
+}
+
+const ScanKernels KERNELS = selectKernels();
+
+} // namespace
+
+const char *scanWhitespace(const char *begin, const char *end) {
+  return KERNELS.whitespace(begin, end);
+}
+
+const char *scanIdentifier(const char *begin, const char *end) {
+  return KERNELS.identifier(begin, end);
+}
+
+const char *scanLine(const char *begin, const char *end) {
+  return KERNELS.line(begin, end);
+}
+
+const char *scanLiteral(const char *begin, const char *end, char quote) {
+  return quote == '"' ? KERNELS.string(begin, end) : KERNELS.character(begin, end);
+}
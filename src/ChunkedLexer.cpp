@@ -0,0 +1,157 @@
+#include "Allocs.h"
+#include "Lexer.h"
+#include "ThreadPool.h"
+#include "TokenBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <thread>
+
+// Lexing of one large buffer on several threads.
+//
+// The buffer is cut into chunks just after a newline and every chunk is
+// lexed speculatively, as if it started outside any token. Because a '\n'
+// is itself a token, the guess is right unless the previous chunk's last
+// token runs past the cut, which only a STRING or CHAR literal with an
+// embedded newline can do. A sequential pass then stitches the chunks
+// together: it resumes each chunk where the previous one really stopped,
+// either at a speculative token that starts exactly there (the lexer is
+// stateless between tokens, so everything after it is right) or, failing
+// that, by re-lexing the rest of the chunk on the calling thread.
+
+namespace {
+
+constexpr size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+struct Chunk {
+  uint32_t begin = 0;
+  uint32_t end = 0;
+};
+
+// Tokens lexed from one starting point. Offsets are the buffer's own, so
+// tokens merge unchanged; symbols, numbers and escaped literals live in the
+// run's own lexer until the run is merged.
+struct Run {
+  SymbolTable symbols;
+  std::unique_ptr<Lexer> lexer;
+  std::vector<Token> tokens;
+  uint32_t stop = 0; // just past the last token
+  bool failed = false;
+};
+
+} // namespace
+
+void Lexer::tokenizeChunked(TokenBuffer &tokens, unsigned jobs) {
+  tokens.attach(*this);
+  if (m_currentToken.type != TokenType::NONE) {
+    tokens.push(nextToken());
+  }
+
+  // Threads are only started for a buffer worth cutting up; a smaller one is
+  // lexed here, as tokenize() would.
+  unsigned threads = jobs != 0 ? jobs : std::max(1u, std::thread::hardware_concurrency());
+  size_t size = m_end - m_cur;
+  size_t count = std::min<size_t>(threads * 2, size / MIN_CHUNK_SIZE);
+  if (count < 2) {
+    tokenize(tokens);
+    return;
+  }
+  ThreadPool pool(static_cast<unsigned>(std::min<size_t>(threads, count)));
+
+  std::vector<Chunk> chunks;
+  uint32_t begin = offset(m_cur);
+  for (size_t i = 1; i <= count && begin < offset(m_end); i++) {
+    const char *cut = m_end;
+    if (i < count) {
+      cut = m_begin + begin + std::max<size_t>(size / count, 1);
+      cut = cut < m_end ? static_cast<const char *>(std::memchr(cut, '\n', m_end - cut)) : nullptr;
+      cut = cut != nullptr ? cut + 1 : m_end;
+    }
+    chunks.push_back(Chunk{ begin, offset(cut) });
+    begin = offset(cut);
+  }
+
+  std::string_view buffer(m_begin, m_end - m_begin);
+
+  auto lexRun = [&](Run &run, const Chunk &chunk, uint32_t from, bool speculative) {
+    run.lexer = std::make_unique<Lexer>(buffer, run.symbols);
+    Lexer &lexer = *run.lexer;
+    lexer.seek(from);
+    run.stop = from;
+    while (true) {
+      Token tok = lexer.readNextToken();
+      if (tok == TokenType::EOB || tok.start() >= chunk.end) {
+        break;
+      }
+      // A stray character is more likely a chunk guessed to start outside
+      // a literal that does not; only a run from a known start keeps it.
+      if (tok == TokenType::INVALID && speculative) {
+        run.failed = true;
+        break;
+      }
+      run.tokens.push_back(tok);
+      run.stop = lexer.offset(lexer.m_cur);
+    }
+  };
+
+  std::vector<Run> runs(chunks.size());
+  for (size_t i = 0; i < chunks.size(); i++) {
+    pool.submit([&, i](unsigned) {
+      ALLOC_SITE(LEXER);
+      lexRun(runs[i], chunks[i], chunks[i].begin, true);
+    });
+  }
+  pool.wait();
+
+  auto merge = [&](Run &run, size_t from) {
+    std::vector<uint32_t> remap(run.symbols.size(), Symbol::NONE);
+    for (size_t i = from; i < run.tokens.size(); i++) {
+      Token tok = run.tokens[i];
+      if (tok == TokenType::IDENTIFIER) {
+        auto &id = remap[tok.id];
+        if (id == Symbol::NONE) {
+          id = m_symbols.intern(run.symbols.name(Symbol{ tok.id })).id;
+        }
+        tok.id = id;
+      } else if ((tok == TokenType::STRING || tok == TokenType::CHAR) && tok.id != 0 && tok.id != literal::UNTERMINATED) {
+        m_escaped.push_back(std::move(run.lexer->m_escaped[tok.id - 1]));
+        tok.id = static_cast<uint32_t>(m_escaped.size());
+      } else if ((tok == TokenType::INTEGER || tok == TokenType::FLOAT) && tok.id != number::MALFORMED && tok.id != number::OUT_OF_RANGE) {
+        m_numbers.push_back(run.lexer->m_numbers[tok.id - 1]);
+        tok.id = static_cast<uint32_t>(m_numbers.size());
+      }
+      tokens.push(tok);
+    }
+  };
+
+  uint32_t pos = chunks.front().begin;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    auto &chunk = chunks[i];
+    auto &run = runs[i];
+
+    if (pos >= chunk.end) {
+      // A literal from an earlier chunk swallowed this one whole.
+    } else if (!run.failed && pos <= chunk.begin) {
+      merge(run, 0);
+      pos = run.stop;
+    } else {
+      auto it = std::lower_bound(run.tokens.begin(), run.tokens.end(), pos, [](const Token &tok, uint32_t pos) {
+        return tok.start() < pos;
+      });
+      if (!run.failed && it != run.tokens.end() && it->start() == pos) {
+        merge(run, it - run.tokens.begin());
+        pos = run.stop;
+      } else {
+        Run exact;
+        lexRun(exact, chunk, pos, false);
+        merge(exact, 0);
+        pos = exact.stop;
+      }
+    }
+  }
+
+  m_cur = m_end;
+  m_currentToken = Token{};
+  tokens.push(Token{ TokenType::EOB, std::string_view(m_end, 0), 0, offset(m_end) });
+}
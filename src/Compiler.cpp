@@ -0,0 +1,582 @@
+#include "Compiler.h"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "SourceMap.h"
+
+// Registers are handed out like a stack. A block's locals stay allocated
+// until the block ends; temporaries are released as soon as the expression
+// that needed them is done, so every compile step below leaves m_freeReg as
+// it found it unless it declared a local. A destination register is always
+// scratch, never a live local, so results can be built up in it directly.
+
+static bool isIntegral(ValueKind kind) {
+  return kind == ValueKind::INT || kind == ValueKind::BOOL || kind == ValueKind::CHAR;
+}
+
+Compiler::Compiler(const AST &ast, const SymbolTable &symbols, const Semantics &semantics)
+  : m_ast(ast), m_symbols(symbols), m_semantics(semantics) { }
+
+Program Compiler::operator()() {
+  NodeId root = m_ast.root();
+  if (root == NO_NODE || m_ast.node(root).type != ASTType::PROG) {
+    throw std::runtime_error("Expected a program to compile");
+  }
+
+  declare();
+  for (uint32_t i = 0; i < m_program.main; i++) {
+    compileFunction(i);
+  }
+  compileMain();
+  return std::move(m_program);
+}
+
+void Compiler::declare() {
+  // Every function is known before any code is compiled, so functions can
+  // call each other in any order.
+  const auto &functions = m_semantics.functions();
+  if (functions.size() > std::numeric_limits<uint16_t>::max()) {
+    throw std::runtime_error("Too many functions to compile");
+  }
+  if (m_semantics.globals().size() > std::numeric_limits<uint16_t>::max()) {
+    throw std::runtime_error("Too many globals to compile");
+  }
+
+  for (const auto &info : functions) {
+    Function function;
+    function.name = &info == &m_semantics.main() ? "<main>" : std::string(m_symbols.name(info.name));
+    function.params = info.params;
+    function.result = info.result;
+    m_program.functions.push_back(std::move(function));
+  }
+  m_program.globals = static_cast<uint32_t>(m_semantics.globals().size());
+  m_program.main = static_cast<uint32_t>(functions.size() - 1);
+}
+
+void Compiler::begin(uint32_t index) {
+  m_function = &m_program.functions[index];
+  m_registers.assign(m_semantics.functions()[index].locals, 0);
+  m_freeReg = 0;
+}
+
+void Compiler::end() {
+  m_function = nullptr;
+}
+
+void Compiler::compileFunction(uint32_t index) {
+  const auto &info = m_semantics.functions()[index];
+  const ASTNode &node = m_ast.node(info.node);
+  begin(index);
+  m_offset = node.offset;
+
+  for (NodeId param : m_ast.list(node.function.params)) {
+    m_registers[m_semantics.slot(param)] = alloc();
+  }
+  uint8_t dst = alloc();
+  ValueKind kind = expr(node.function.body, dst);
+  convert(dst, kind, info.result);
+  emit(OpCode::RET, dst);
+  end();
+}
+
+void Compiler::compileMain() {
+  const ASTNode &node = m_ast.node(m_semantics.main().node);
+  begin(m_program.main);
+  m_offset = node.offset;
+
+  uint8_t dst = alloc();
+  loadInt(dst, 0);
+  for (NodeId id : m_ast.list(node.prog.body)) {
+    switch (m_ast.node(id).type) {
+    case ASTType::FUNCTION:
+      break;
+    case ASTType::VAR:
+      var(id, dst);
+      break;
+    default:
+      expr(id, dst);
+      break;
+    }
+  }
+  emit(OpCode::RET, dst);
+  end();
+}
+
+ValueKind Compiler::expr(NodeId id, uint8_t dst) {
+  const ASTNode &node = m_ast.node(id);
+  auto offset = m_offset;
+  m_offset = node.offset;
+
+  ValueKind kind = ValueKind::INT;
+  switch (node.type) {
+  case ASTType::NAME:
+    if (m_semantics.depth(id) == 0) {
+      emitBx(OpCode::LOADG, dst, m_semantics.slot(id));
+    } else {
+      emit(OpCode::MOVE, dst, m_registers[m_semantics.slot(id)]);
+    }
+    kind = m_semantics.kind(id);
+    break;
+  case ASTType::INTEGER:
+    loadInt(dst, node.integer);
+    break;
+  case ASTType::FLOAT:
+    loadConstant(dst, Slot{ .f = node.real });
+    kind = ValueKind::FLOAT;
+    break;
+  case ASTType::BOOL:
+    loadInt(dst, node.boolean);
+    kind = ValueKind::BOOL;
+    break;
+  case ASTType::CHAR:
+    loadInt(dst, static_cast<unsigned char>(node.character));
+    kind = ValueKind::CHAR;
+    break;
+  case ASTType::STRING: {
+    auto text = m_ast.string(node.string);
+    uint16_t index = 0;
+    if (!text.empty()) {
+      auto [it, added] = m_strings.emplace(text, static_cast<uint16_t>(m_program.strings.size()));
+      if (added) {
+        if (m_program.strings.size() > std::numeric_limits<uint16_t>::max()) {
+          error("Too many strings to compile", node);
+        }
+        m_program.strings.emplace_back(text);
+      }
+      index = it->second;
+    }
+    loadInt(dst, index);
+    kind = ValueKind::STRING;
+    break;
+  }
+  case ASTType::PROG:
+    kind = prog(node.prog.body, dst);
+    break;
+  case ASTType::BINARY:
+    kind = chain(id, dst);
+    break;
+  case ASTType::ASSIGN:
+    kind = assign(id, dst);
+    break;
+  case ASTType::UNARY:
+    kind = unary(id, dst);
+    break;
+  case ASTType::IF:
+    kind = branch(id, dst);
+    break;
+  case ASTType::CALL:
+    kind = call(id, dst);
+    break;
+  default:
+    error("Cannot compile " + std::string(astTypeName(node.type)), node);
+  }
+
+  m_offset = offset;
+  return kind;
+}
+
+ValueKind Compiler::prog(NodeList body, uint8_t dst) {
+  uint32_t mark = m_freeReg;
+
+  ValueKind kind = ValueKind::INT;
+  if (body.size == 0) {
+    loadInt(dst, 0);
+  }
+  for (NodeId id : m_ast.list(body)) {
+    if (m_ast.node(id).type == ASTType::VAR) {
+      kind = var(id, dst);
+    } else {
+      kind = expr(id, dst);
+    }
+  }
+
+  m_freeReg = mark;
+  return kind;
+}
+
+ValueKind Compiler::var(NodeId id, uint8_t dst) {
+  const ASTNode &node = m_ast.node(id);
+  ValueKind kind = m_semantics.kind(id);
+  bool global = m_semantics.depth(id) == 0;
+  m_offset = node.offset;
+
+  uint8_t reg = global ? dst : alloc();
+  if (node.var.init != NO_NODE) {
+    convert(reg, expr(node.var.init, reg), kind);
+  } else {
+    loadInt(reg, 0);
+  }
+
+  if (global) {
+    emitBx(OpCode::STOREG, reg, m_semantics.slot(id));
+  } else {
+    // Only from here on does the name mean this local.
+    m_registers[m_semantics.slot(id)] = reg;
+    emit(OpCode::MOVE, dst, reg);
+  }
+  return kind;
+}
+
+ValueKind Compiler::assign(NodeId id, uint8_t dst) {
+  size_t base = m_chain.size();
+  NodeId value = id;
+  for (; m_ast.node(value).type == ASTType::ASSIGN; value = m_ast.node(value).binary.right) {
+    m_chain.push_back(value);
+  }
+
+  // The value is stored to each target in turn, innermost first.
+  ValueKind kind = expr(value, dst);
+  while (m_chain.size() > base) {
+    const ASTNode &node = m_ast.node(m_chain.back());
+    m_chain.pop_back();
+    m_offset = node.offset;
+    NodeId target = node.binary.left;
+
+    convert(dst, kind, m_semantics.kind(target));
+    kind = m_semantics.kind(target);
+    if (m_semantics.depth(target) == 0) {
+      emitBx(OpCode::STOREG, dst, m_semantics.slot(target));
+    } else {
+      emit(OpCode::MOVE, m_registers[m_semantics.slot(target)], dst);
+    }
+  }
+  return kind;
+}
+
+ValueKind Compiler::chain(NodeId id, uint8_t dst) {
+  size_t base = m_chain.size();
+  NodeId leaf = id;
+  for (; m_ast.node(leaf).type == ASTType::BINARY; leaf = m_ast.node(leaf).binary.left) {
+    m_chain.push_back(leaf);
+  }
+
+  // An arithmetic operator reads a local on its left from the local's own
+  // register; anything else is compiled into dst.
+  Operator first = m_ast.node(m_chain.back()).binary.op;
+  ValueKind kind;
+  uint8_t l = dst;
+  if (first != Operator::AND && first != Operator::OR
+      && m_ast.node(leaf).type == ASTType::NAME && m_semantics.depth(leaf) != 0) {
+    kind = m_semantics.kind(leaf);
+    l = m_registers[m_semantics.slot(leaf)];
+  } else {
+    kind = expr(leaf, dst);
+  }
+
+  while (m_chain.size() > base) {
+    const ASTNode &node = m_ast.node(m_chain.back());
+    m_chain.pop_back();
+    m_offset = node.offset;
+    if (node.binary.op == Operator::AND || node.binary.op == Operator::OR) {
+      kind = logical(node, kind, dst);
+    } else {
+      kind = binary(node, l, kind, dst);
+    }
+    l = dst;
+  }
+  return kind;
+}
+
+ValueKind Compiler::binary(const ASTNode &node, uint8_t l, ValueKind lk, uint8_t dst) {
+  Operator op = node.binary.op;
+  uint32_t mark = m_freeReg;
+
+  ValueKind rk;
+  int budget = 16;
+  if (l != dst && !pure(node.binary.right, budget)) {
+    // The right operand may assign the local on the left, whose value has
+    // to be the one from before.
+    emit(OpCode::MOVE, dst, l);
+    l = dst;
+  }
+  uint8_t r = operand(node.binary.right, rk);
+
+  bool compare = op == Operator::EQ || op == Operator::NE || op == Operator::LT
+    || op == Operator::GT || op == Operator::LE || op == Operator::GE;
+  bool real = lk == ValueKind::FLOAT || rk == ValueKind::FLOAT;
+  if (real) {
+    if (lk != ValueKind::FLOAT) {
+      emit(OpCode::I2F, dst, l);
+      l = dst;
+    }
+    if (rk != ValueKind::FLOAT) {
+      uint8_t t = r < mark ? alloc() : r;
+      emit(OpCode::I2F, t, r);
+      r = t;
+    }
+  }
+
+  OpCode code;
+  switch (op) {
+  case Operator::ADD: code = real ? OpCode::ADDF : OpCode::ADDI; break;
+  case Operator::SUB: code = real ? OpCode::SUBF : OpCode::SUBI; break;
+  case Operator::MUL: code = real ? OpCode::MULF : OpCode::MULI; break;
+  case Operator::DIV: code = real ? OpCode::DIVF : OpCode::DIVI; break;
+  case Operator::MOD: code = real ? OpCode::MODF : OpCode::MODI; break;
+  case Operator::EQ: code = real ? OpCode::EQF : OpCode::EQI; break;
+  case Operator::NE: code = real ? OpCode::NEF : OpCode::NEI; break;
+  case Operator::LT: code = real ? OpCode::LTF : OpCode::LTI; break;
+  case Operator::LE: code = real ? OpCode::LEF : OpCode::LEI; break;
+  case Operator::GT: code = real ? OpCode::LTF : OpCode::LTI; std::swap(l, r); break;
+  case Operator::GE: code = real ? OpCode::LEF : OpCode::LEI; std::swap(l, r); break;
+  default:
+    error("Cannot compile operator '" + std::string(operatorName(op)) + "'", node);
+  }
+  emit(code, dst, l, r);
+
+  m_freeReg = mark;
+  if (compare) {
+    return ValueKind::BOOL;
+  }
+  return real ? ValueKind::FLOAT : ValueKind::INT;
+}
+
+ValueKind Compiler::logical(const ASTNode &node, ValueKind lk, uint8_t dst) {
+  toBool(dst, lk);
+  size_t jump = emit(node.binary.op == Operator::AND ? OpCode::JMPF : OpCode::JMPT, dst);
+  toBool(dst, expr(node.binary.right, dst));
+  patch(jump);
+  return ValueKind::BOOL;
+}
+
+ValueKind Compiler::unary(NodeId id, uint8_t dst) {
+  const ASTNode &node = m_ast.node(id);
+
+  // A local is read from its own register; anything else is compiled into
+  // dst and the operator applied in place, so nested prefix operators take
+  // no registers of their own.
+  NodeId operand = node.unary.operand;
+  ValueKind kind;
+  uint8_t reg = dst;
+  if (m_ast.node(operand).type == ASTType::NAME && m_semantics.depth(operand) != 0) {
+    kind = m_semantics.kind(operand);
+    reg = m_registers[m_semantics.slot(operand)];
+  } else {
+    kind = expr(operand, dst);
+  }
+  switch (node.unary.op) {
+  case Operator::SUB:
+  case Operator::ADD:
+    if (node.unary.op == Operator::ADD) {
+      emit(OpCode::MOVE, dst, reg);
+    } else {
+      emit(kind == ValueKind::FLOAT ? OpCode::NEGF : OpCode::NEGI, dst, reg);
+    }
+    kind = kind == ValueKind::FLOAT ? ValueKind::FLOAT : ValueKind::INT;
+    break;
+  case Operator::NOT:
+    if (kind == ValueKind::FLOAT) {
+      emit(OpCode::TESTF, dst, reg);
+      reg = dst;
+    }
+    emit(OpCode::NOT, dst, reg);
+    kind = ValueKind::BOOL;
+    break;
+  default:
+    error("Cannot compile operator '" + std::string(operatorName(node.unary.op)) + "'", node);
+  }
+  return kind;
+}
+
+ValueKind Compiler::branch(NodeId id, uint8_t dst) {
+  const ASTNode &node = m_ast.node(id);
+  uint32_t mark = m_freeReg;
+
+  ValueKind ck;
+  uint8_t cond = operand(node.if_.cond, ck);
+  if (ck == ValueKind::FLOAT) {
+    emit(OpCode::TESTF, dst, cond);
+    cond = dst;
+  }
+  size_t toElse = emit(OpCode::JMPF, cond);
+  m_freeReg = mark;
+
+  ValueKind tk = expr(node.if_.then, dst);
+  size_t toEnd = emit(OpCode::JMP);
+  patch(toElse);
+  ValueKind ek = tk;
+  if (node.if_.else_ != NO_NODE) {
+    ek = expr(node.if_.else_, dst);
+  } else {
+    // Zero is a valid value of every kind.
+    loadInt(dst, 0);
+  }
+
+  if (tk == ek || (isIntegral(tk) && isIntegral(ek))) {
+    patch(toEnd);
+    return tk == ek ? tk : ValueKind::INT;
+  }
+  // One side is float: widen the other where it ends.
+  if (ek != ValueKind::FLOAT) {
+    emit(OpCode::I2F, dst, dst);
+  }
+  if (tk != ValueKind::FLOAT) {
+    size_t over = emit(OpCode::JMP);
+    patch(toEnd);
+    emit(OpCode::I2F, dst, dst);
+    patch(over);
+  } else {
+    patch(toEnd);
+  }
+  return ValueKind::FLOAT;
+}
+
+ValueKind Compiler::call(NodeId id, uint8_t dst) {
+  const ASTNode &node = m_ast.node(id);
+  auto args = m_ast.list(node.call.args);
+  uint32_t mark = m_freeReg;
+
+  uint32_t index = m_semantics.slot(id);
+  if (index == Semantics::PRINT) {
+    for (size_t i = 0; i < args.size(); i++) {
+      ValueKind kind;
+      uint8_t reg = operand(args[i], kind);
+      emit(OpCode::PRINT, reg, static_cast<uint8_t>(kind), i + 1 == args.size());
+      m_freeReg = mark;
+    }
+    loadInt(dst, 0);
+    if (args.empty()) {
+      emit(OpCode::PRINT, dst, static_cast<uint8_t>(ValueKind::STRING), 1);
+    }
+    return ValueKind::INT;
+  }
+
+  const Function &function = m_program.functions[index];
+  // Arguments go in consecutive registers, which become the callee's first
+  // registers. When dst is the newest temporary they can start right there,
+  // and the result needs no move.
+  bool inPlace = dst + 1u == m_freeReg;
+  uint8_t base = inPlace ? dst : static_cast<uint8_t>(m_freeReg);
+  for (size_t i = 0; i < args.size(); i++) {
+    uint8_t reg = inPlace && i == 0 ? dst : alloc();
+    convert(reg, expr(args[i], reg), function.params[i]);
+  }
+  if (args.empty() && !inPlace) {
+    alloc();
+  }
+  emitBx(OpCode::CALL, base, index);
+  if (!inPlace) {
+    emit(OpCode::MOVE, dst, base);
+  }
+
+  m_freeReg = mark;
+  return function.result;
+}
+
+uint8_t Compiler::operand(NodeId id, ValueKind &kind) {
+  if (m_ast.node(id).type == ASTType::NAME && m_semantics.depth(id) != 0) {
+    kind = m_semantics.kind(id);
+    return m_registers[m_semantics.slot(id)];
+  }
+  uint8_t reg = alloc();
+  kind = expr(id, reg);
+  return reg;
+}
+
+uint8_t Compiler::alloc() {
+  if (m_freeReg > std::numeric_limits<uint8_t>::max()) {
+    throw SourceError("Function '" + m_function->name + "' needs more than 256 registers", m_offset);
+  }
+  m_function->registers = std::max(m_function->registers, m_freeReg + 1);
+  return static_cast<uint8_t>(m_freeReg++);
+}
+
+void Compiler::convert(uint8_t reg, ValueKind from, ValueKind to) {
+  if (to == ValueKind::FLOAT && from != ValueKind::FLOAT) {
+    emit(OpCode::I2F, reg, reg);
+  }
+}
+
+void Compiler::toBool(uint8_t reg, ValueKind kind) {
+  if (kind == ValueKind::FLOAT) {
+    emit(OpCode::TESTF, reg, reg);
+  } else if (kind != ValueKind::BOOL) {
+    emit(OpCode::TESTI, reg, reg);
+  }
+}
+
+bool Compiler::pure(NodeId id, int &budget) const {
+  if (id == NO_NODE) {
+    return true;
+  }
+  if (--budget < 0) {
+    return false;
+  }
+  const ASTNode &node = m_ast.node(id);
+  switch (node.type) {
+  case ASTType::NAME:
+  case ASTType::BOOL:
+  case ASTType::INTEGER:
+  case ASTType::FLOAT:
+  case ASTType::STRING:
+  case ASTType::CHAR:
+    return true;
+  case ASTType::BINARY:
+    return pure(node.binary.left, budget) && pure(node.binary.right, budget);
+  case ASTType::UNARY:
+    return pure(node.unary.operand, budget);
+  case ASTType::IF:
+    return pure(node.if_.cond, budget) && pure(node.if_.then, budget) && pure(node.if_.else_, budget);
+  case ASTType::CALL:
+    // A callee has its own frame and cannot reach the caller's locals.
+    for (NodeId arg : m_ast.list(node.call.args)) {
+      if (!pure(arg, budget)) {
+        return false;
+      }
+    }
+    return true;
+  default:
+    return false;
+  }
+}
+
+size_t Compiler::emit(OpCode op, uint8_t a, uint8_t b, uint8_t c) {
+  m_function->code.push_back(Instr{ op, a, b, c });
+  m_function->offsets.push_back(m_offset);
+  return m_function->code.size() - 1;
+}
+
+size_t Compiler::emitBx(OpCode op, uint8_t a, uint32_t bx) {
+  return emit(op, a, static_cast<uint8_t>(bx & 0xff), static_cast<uint8_t>(bx >> 8));
+}
+
+void Compiler::loadInt(uint8_t dst, int64_t value) {
+  if (value >= std::numeric_limits<int16_t>::min() && value <= std::numeric_limits<int16_t>::max()) {
+    emitBx(OpCode::LOADI, dst, static_cast<uint16_t>(value));
+  } else {
+    loadConstant(dst, Slot{ .i = value });
+  }
+}
+
+void Compiler::loadConstant(uint8_t dst, Slot value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  auto [it, added] = m_constants.emplace(bits, static_cast<uint16_t>(m_program.constants.size()));
+  if (added) {
+    if (m_program.constants.size() > std::numeric_limits<uint16_t>::max()) {
+      throw SourceError("Too many constants to compile", m_offset);
+    }
+    m_program.constants.push_back(value);
+  }
+  emitBx(OpCode::LOADK, dst, it->second);
+}
+
+void Compiler::patch(size_t jump) {
+  patchTo(jump, m_function->code.size());
+}
+
+void Compiler::patchTo(size_t jump, size_t target) {
+  auto offset = static_cast<int64_t>(target) - static_cast<int64_t>(jump + 1);
+  if (offset < std::numeric_limits<int16_t>::min() || offset > std::numeric_limits<int16_t>::max()) {
+    throw SourceError("Jump too far in '" + m_function->name + "'", m_function->offsets[jump]);
+  }
+  auto bx = static_cast<uint16_t>(offset);
+  m_function->code[jump].b = static_cast<uint8_t>(bx & 0xff);
+  m_function->code[jump].c = static_cast<uint8_t>(bx >> 8);
+}
+
+void Compiler::error(const std::string &message, const ASTNode &at) const {
+  throw SourceError(message, at.offset);
+}
@@ -0,0 +1,218 @@
+#include "Counters.h"
+
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace counters {
+  namespace {
+    constexpr std::string_view PHASE_NAMES[PHASES] = { "lex", "parse", "fold", "resolve", "compile", "run" };
+    constexpr std::string_view EVENT_NAMES[EVENTS] = {
+      "cycles", "instructions", "l1d_misses", "llc_misses", "branch_misses",
+    };
+
+#ifdef __linux__
+    struct EventConfig {
+      uint32_t type;
+      uint64_t config;
+    };
+    constexpr EventConfig EVENT_CONFIGS[EVENTS] = {
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+      { PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+      { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    };
+
+    // One counter group per thread, opened the first time the thread takes
+    // a reading and left running until it exits; a reading is then a single
+    // read() of the whole group. Events the kernel refuses are left out, and
+    // if it refuses them all the group is empty and readings carry only the
+    // time.
+    class Group {
+    private:
+      int m_fds[EVENTS];
+      uint8_t m_slots[EVENTS]; // position of each event in the group read
+      uint8_t m_counted = 0;
+      uint8_t m_members = 0;
+
+    public:
+      Group() {
+        int leader = -1;
+        for (size_t e = 0; e < EVENTS; e++) {
+          perf_event_attr attr{};
+          attr.size = sizeof(attr);
+          attr.type = EVENT_CONFIGS[e].type;
+          attr.config = EVENT_CONFIGS[e].config;
+          attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+          // User space only, which is all an unprivileged process may count.
+          attr.exclude_kernel = 1;
+          attr.exclude_hv = 1;
+          m_fds[e] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader, PERF_FLAG_FD_CLOEXEC));
+          if (m_fds[e] < 0) {
+            continue;
+          }
+          if (leader < 0) {
+            leader = m_fds[e];
+          }
+          m_slots[e] = m_members++;
+          m_counted |= 1 << e;
+        }
+      }
+      ~Group() {
+        for (size_t e = 0; e < EVENTS; e++) {
+          if ((m_counted >> e) & 1) {
+            close(m_fds[e]);
+          }
+        }
+      }
+
+      Group(const Group &) = delete;
+      Group &operator =(const Group &) = delete;
+
+      void read(Reading &reading) const {
+        if (m_counted == 0) {
+          return;
+        }
+        // nr, time_enabled, time_running, then one value per member.
+        uint64_t data[3 + EVENTS];
+        int leader = m_fds[__builtin_ctz(m_counted)];
+        if (::read(leader, data, sizeof(uint64_t) * (3 + m_members)) <= 0) {
+          return;
+        }
+        reading.enabled = data[1];
+        reading.running = data[2];
+        for (size_t e = 0; e < EVENTS; e++) {
+          if ((m_counted >> e) & 1) {
+            reading.values[e] = data[3 + m_slots[e]];
+          }
+        }
+        reading.counted = m_counted;
+      }
+    };
+
+    thread_local Group GROUP;
+#endif
+
+    void printJsonString(std::ostream &os, std::string_view text) {
+      os << '"';
+      for (char c : text) {
+        if (c == '"' || c == '\\') {
+          os << '\\';
+        }
+        os << c;
+      }
+      os << '"';
+    }
+  } // namespace
+
+  std::string_view phaseName(Phase phase) {
+    return PHASE_NAMES[static_cast<size_t>(phase)];
+  }
+
+  std::string_view eventName(Event event) {
+    return EVENT_NAMES[static_cast<size_t>(event)];
+  }
+
+  Reading Reading::now() {
+    Reading reading;
+    reading.time = std::chrono::steady_clock::now();
+#ifdef __linux__
+    GROUP.read(reading);
+#endif
+    return reading;
+  }
+
+  void Profile::add(Phase phase, const Reading &start, const Reading &end) {
+    Totals &totals = m_phases[static_cast<size_t>(phase)];
+    totals.scopes++;
+    totals.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(end.time - start.time).count();
+
+    uint8_t counted = start.counted & end.counted;
+    m_counted = m_started ? m_counted & counted : counted;
+    m_started = true;
+    uint64_t enabled = end.enabled - start.enabled;
+    uint64_t running = end.running - start.running;
+    for (size_t e = 0; e < EVENTS; e++) {
+      if (!((counted >> e) & 1)) {
+        continue;
+      }
+      uint64_t delta = end.values[e] - start.values[e];
+      // With more groups than the PMU has counters the kernel time-slices
+      // them; extrapolate to the whole scope as perf does.
+      if (running != 0 && running < enabled) {
+        delta = static_cast<uint64_t>(static_cast<double>(delta) * enabled / running);
+      }
+      totals.values[e] += delta;
+    }
+  }
+
+  void Profile::printTable(std::ostream &os, std::string_view path) const {
+    bool any = m_counted != 0;
+    os << path << ':' << (any ? "" : " hardware counters unavailable, timing only") << '\n';
+    os << "  " << std::left << std::setw(8) << "phase" << std::right << std::setw(12) << "ms";
+    if (any) {
+      for (size_t e = 0; e < EVENTS; e++) {
+        os << std::setw(15) << EVENT_NAMES[e];
+      }
+      os << std::setw(7) << "ipc";
+    }
+    os << '\n';
+
+    for (size_t p = 0; p < PHASES; p++) {
+      const Totals &totals = m_phases[p];
+      if (totals.scopes == 0) {
+        continue;
+      }
+      os << "  " << std::left << std::setw(8) << PHASE_NAMES[p] << std::right << std::setw(12) << std::fixed
+         << std::setprecision(3) << totals.nanos / 1e6;
+      if (any) {
+        for (size_t e = 0; e < EVENTS; e++) {
+          if (counted(static_cast<Event>(e))) {
+            os << std::setw(15) << totals.values[e];
+          } else {
+            os << std::setw(15) << '-';
+          }
+        }
+        uint64_t cycles = totals.values[static_cast<size_t>(Event::CYCLES)];
+        if (counted(Event::CYCLES) && counted(Event::INSTRUCTIONS) && cycles != 0) {
+          os << std::setw(7) << std::setprecision(2)
+             << static_cast<double>(totals.values[static_cast<size_t>(Event::INSTRUCTIONS)]) / cycles;
+        } else {
+          os << std::setw(7) << '-';
+        }
+      }
+      os << '\n';
+    }
+    os << std::defaultfloat;
+  }
+
+  void Profile::printJson(std::ostream &os, std::string_view path) const {
+    os << "{\"path\": ";
+    printJsonString(os, path);
+    os << ", \"counters\": " << (m_counted != 0 ? "true" : "false") << ", \"phases\": [";
+    bool first = true;
+    for (size_t p = 0; p < PHASES; p++) {
+      const Totals &totals = m_phases[p];
+      if (totals.scopes == 0) {
+        continue;
+      }
+      os << (first ? "" : ", ") << "{\"phase\": \"" << PHASE_NAMES[p] << "\", \"ns\": " << totals.nanos;
+      for (size_t e = 0; e < EVENTS; e++) {
+        os << ", \"" << EVENT_NAMES[e] << "\": ";
+        if (counted(static_cast<Event>(e))) {
+          os << totals.values[e];
+        } else {
+          os << "null";
+        }
+      }
+      os << '}';
+      first = false;
+    }
+    os << "]}\n";
+  }
+} // namespace counters
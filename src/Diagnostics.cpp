@@ -0,0 +1,77 @@
+#include "Diagnostics.h"
+
+#include "Lexer.h"
+
+static std::string escapeChar(char c) {
+  char letter = ESCAPE_LETTERS[static_cast<unsigned char>(c)];
+  return letter != 0 ? std::string{ '\\', letter } : std::string(1, c);
+}
+
+void Diagnostics::report(const Diagnostic &diagnostic) {
+  m_diagnostics.push_back(diagnostic);
+}
+
+void Diagnostics::print(std::ostream &os, std::string_view prefix, const SourceMap &source) const {
+  for (const Diagnostic &diagnostic : m_diagnostics) {
+    os << prefix << ": " << format(diagnostic, source) << '\n';
+  }
+}
+
+std::string Diagnostics::format(const Diagnostic &diagnostic, const SourceMap &source) {
+  std::string text;
+  if (diagnostic.offset < source.text().size()) {
+    text = source.text().substr(diagnostic.offset, diagnostic.length);
+  }
+  auto number = [&](const char *problem) {
+    bool real = static_cast<TokenType>(diagnostic.arg) == TokenType::FLOAT;
+    return std::string(real ? "Float" : "Integer") + " literal '" + text + "' " + problem;
+  };
+
+  std::string message;
+  switch (diagnostic.code) {
+  case DiagnosticCode::UNEXPECTED_CHARACTER:
+    message = "Unexpected character '" + escapeChar(static_cast<char>(diagnostic.arg)) + "'";
+    break;
+  case DiagnosticCode::UNEXPECTED_TOKEN:
+    message = "Unexpected token '" + text + "'";
+    break;
+  case DiagnosticCode::EXPECTED_KEYWORD:
+    message = "Expected keyword '" + std::string(keywordName(static_cast<Keyword>(diagnostic.arg))) + "'";
+    break;
+  case DiagnosticCode::EXPECTED_OPERATOR:
+    message = "Expected operator '" + std::string(operatorName(static_cast<Operator>(diagnostic.arg))) + "'";
+    break;
+  case DiagnosticCode::EXPECTED_PUNCTUATOR:
+    message = "Expected punctuator '" + escapeChar(static_cast<char>(diagnostic.arg)) + "'";
+    break;
+  case DiagnosticCode::EXPECTED_IDENTIFIER:
+    message = "Expected identifier";
+    break;
+  case DiagnosticCode::EXPECTED_TYPE:
+    message = "Expected type";
+    break;
+  case DiagnosticCode::EXPECTED_END:
+    message = "Expected 'end'";
+    break;
+  case DiagnosticCode::EXPECTED_FUNCTION_BODY:
+    message = "Expected function body to be a program";
+    break;
+  case DiagnosticCode::MALFORMED_NUMBER:
+    message = number("is malformed");
+    break;
+  case DiagnosticCode::NUMBER_OUT_OF_RANGE:
+    message = number("is out of range");
+    break;
+  case DiagnosticCode::MALFORMED_CHAR:
+    message = "Character literal does not hold exactly one character";
+    break;
+  case DiagnosticCode::UNTERMINATED_LITERAL:
+    message = static_cast<TokenType>(diagnostic.arg) == TokenType::CHAR ? "Unterminated character literal"
+                                                                         : "Unterminated string literal";
+    break;
+  case DiagnosticCode::NESTED_TOO_DEEPLY:
+    message = "Nested more than " + std::to_string(diagnostic.arg) + " levels deep";
+    break;
+  }
+  return message + " at " + source.locate(diagnostic.offset);
+}
@@ -0,0 +1,112 @@
+#include "Driver.h"
+
+#include <memory>
+#include <optional>
+
+#include "ThreadPool.h"
+
+ParseResult parseFile(const std::string &path, TokenMode mode, const ASTCache *cache, bool profile, uint32_t maxDepth) {
+  ParseResult result;
+  result.path = path;
+  try {
+    result.source = Source::mapFile(path);
+  } catch (const std::exception &e) {
+    result.error = e.what();
+    return result;
+  }
+  parseSource(result, mode, cache, profile, maxDepth);
+  return result;
+}
+
+void parseSource(ParseResult &result, TokenMode mode, const ASTCache *cache, bool profile, uint32_t maxDepth) {
+  counters::Profile *counted = profile ? &result.profile : nullptr;
+  try {
+    ASTCache::Key key{};
+    if (cache != nullptr) {
+      key = ASTCache::keyOf(result.source.view());
+      if (cache->load(key, result.symbols, result.ast)) {
+        return;
+      }
+    }
+
+    Lexer lexer(result.source.view(), result.symbols);
+    // Unless the mode is ON_DEMAND the parser tokenizes all of its input as
+    // it is constructed.
+    std::optional<Parser> parser;
+    {
+      counters::Scope scope(counted, counters::Phase::LEX);
+      parser.emplace(lexer, mode);
+    }
+    parser->setMaxDepth(maxDepth);
+    {
+      counters::Scope scope(counted, counters::Phase::PARSE);
+      (*parser)(result.ast);
+    }
+    result.tokens = parser->tokens();
+    result.diagnostics = std::move(parser->diagnostics());
+    if (!result.diagnostics.empty()) {
+      return;
+    }
+
+    if (cache != nullptr) {
+      try {
+        cache->store(key, result.symbols, result.ast);
+      } catch (const std::exception &) {
+        // The cache only saves time; a file it cannot take still parsed.
+      }
+    }
+  } catch (const std::exception &e) {
+    result.error = e.what();
+  }
+}
+
+void ParseResult::report(std::ostream &os) const {
+  if (!error.empty()) {
+    os << path << ": " << error << '\n';
+  }
+  diagnostics.print(os, path, SourceMap(source.view()));
+}
+
+void ParseResult::clear() {
+  path.clear();
+  symbols.clear();
+  ast.clear();
+  diagnostics.clear();
+  source = Source();
+  error.clear();
+  tokens = 0;
+  profile = counters::Profile();
+}
+
+std::vector<ParseResult> parseFiles(const std::vector<std::string> &paths, const DriverOptions &options) {
+  std::vector<ParseResult> results(paths.size());
+  std::unique_ptr<ASTCache> cache;
+  if (!options.cacheDir.empty()) {
+    cache = std::make_unique<ASTCache>(options.cacheDir);
+  }
+  if (paths.size() == 1 && options.jobs != 1 && options.mode == TokenMode::PRELEXED) {
+    // A lone file cannot be spread over files, so spread its lexing instead.
+    results[0] = parseFile(paths[0], TokenMode::CHUNKED, cache.get(), options.profile, options.maxDepth);
+    return results;
+  }
+  if (paths.size() <= 1 || options.jobs == 1) {
+    for (size_t i = 0; i < paths.size(); i++) {
+      results[i] = parseFile(paths[i], options.mode, cache.get(), options.profile, options.maxDepth);
+    }
+    return results;
+  }
+
+  // Arenas are per file rather than per worker: each AST is handed back to
+  // the caller and outlives the worker, and one file's result can be kept or
+  // dropped without the others that happened to share its thread.
+  ThreadPool pool(options.jobs);
+  for (size_t i = 0; i < paths.size(); i++) {
+    // Every task writes only its own slot, so no further locking is needed.
+    pool.submit([&results, &paths, &options, &cache, i](unsigned) {
+      results[i] = parseFile(paths[i], options.mode, cache.get(), options.profile, options.maxDepth);
+    });
+  }
+  pool.wait();
+
+  return results;
+}
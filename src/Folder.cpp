@@ -0,0 +1,503 @@
+#include "Folder.h"
+
+#include <cmath>
+#include <string>
+#include <utility>
+
+// Kinds follow Compiler's rules, so that whatever replaces a node compiles
+// to a value of the kind the node had. Where a kind depends on a name or a
+// call it is unknown here, and anything that would need it is left alone.
+
+using Kind = std::optional<ValueKind>;
+
+static bool isIntegral(Kind kind) {
+  return kind == ValueKind::INT || kind == ValueKind::BOOL || kind == ValueKind::CHAR;
+}
+
+static bool isNumeric(Kind kind) {
+  return isIntegral(kind) || kind == ValueKind::FLOAT;
+}
+
+static bool isComparison(Operator op) {
+  return op == Operator::EQ || op == Operator::NE || op == Operator::LT
+    || op == Operator::GT || op == Operator::LE || op == Operator::GE;
+}
+
+static Kind binaryKind(Operator op, Kind left, Kind right) {
+  if (isComparison(op) || op == Operator::AND || op == Operator::OR) {
+    return ValueKind::BOOL;
+  }
+  if (left == ValueKind::FLOAT || right == ValueKind::FLOAT) {
+    return ValueKind::FLOAT;
+  }
+  if (isIntegral(left) && isIntegral(right)) {
+    return ValueKind::INT;
+  }
+  return std::nullopt;
+}
+
+static Kind unaryKind(Operator op, Kind operand) {
+  if (op == Operator::NOT) {
+    return ValueKind::BOOL;
+  }
+  if (isNumeric(operand)) {
+    return operand == ValueKind::FLOAT ? ValueKind::FLOAT : ValueKind::INT;
+  }
+  return std::nullopt;
+}
+
+// What an `if` evaluates to; without an else, the value is a zero of the
+// then branch's kind.
+static Kind branchKind(Kind then, Kind otherwise, bool hasElse) {
+  if (!hasElse || then == otherwise) {
+    return then;
+  }
+  if (isIntegral(then) && isIntegral(otherwise)) {
+    return ValueKind::INT;
+  }
+  if (isNumeric(then) && isNumeric(otherwise)) {
+    return ValueKind::FLOAT;
+  }
+  return std::nullopt;
+}
+
+Folder::Folder(const AST &ast) : m_ast(ast) { }
+
+// As the compiler tests a condition: a float against zero, a string by
+// whether it is empty, anything else as an integer.
+bool Folder::truthy(const Constant &c) {
+  if (c.kind == ValueKind::FLOAT) {
+    return c.value.f != 0.0;
+  }
+  if (c.kind == ValueKind::STRING) {
+    return !c.text.empty();
+  }
+  return c.value.i != 0;
+}
+
+AST Folder::operator()() {
+  m_out.clear();
+  m_kinds.clear();
+  m_visited = 0;
+
+  NodeId root = m_ast.root();
+  if (root != NO_NODE && m_ast.node(root).type == ASTType::PROG) {
+    // The program stays a block, whatever it holds.
+    m_visited++;
+    ASTNode node = m_ast.node(root);
+    std::vector<NodeId> body = statements(node.prog.body, true);
+    node.prog.body = m_out.addList(body);
+    m_out.setRoot(emit(node, std::nullopt));
+  } else {
+    m_out.setRoot(fold(root, true));
+  }
+
+  m_removed = m_visited - m_out.size();
+  m_kinds.clear();
+  return std::move(m_out);
+}
+
+NodeId Folder::fold(NodeId id, bool used) {
+  if (id == NO_NODE) {
+    return NO_NODE;
+  }
+  m_visited++;
+
+  ASTNode node = m_ast.node(id);
+  Kind kind;
+  switch (node.type) {
+  case ASTType::INTEGER:
+    kind = ValueKind::INT;
+    break;
+  case ASTType::FLOAT:
+    kind = ValueKind::FLOAT;
+    break;
+  case ASTType::BOOL:
+    kind = ValueKind::BOOL;
+    break;
+  case ASTType::CHAR:
+    kind = ValueKind::CHAR;
+    break;
+  case ASTType::STRING:
+    node.string = m_out.addString(m_ast.string(node.string));
+    kind = ValueKind::STRING;
+    break;
+  case ASTType::PROG:
+    return prog(node, used);
+  case ASTType::FUNCTION:
+    node.function.params = list(node.function.params);
+    node.function.body = fold(node.function.body, true);
+    break;
+  case ASTType::CALL:
+    node.call.func = fold(node.call.func, true);
+    node.call.args = list(node.call.args);
+    break;
+  case ASTType::VAR:
+    node.var.init = fold(node.var.init, true);
+    break;
+  case ASTType::ASSIGN:
+    return assign(id);
+  case ASTType::BINARY:
+    return chain(id);
+  case ASTType::UNARY:
+    return unary(node);
+  case ASTType::IF:
+    return branch(node, used);
+  default:
+    break;
+  }
+  return emit(node, kind);
+}
+
+std::vector<NodeId> Folder::statements(NodeList body, bool used) {
+  auto input = m_ast.list(body);
+  std::vector<NodeId> ids;
+  ids.reserve(input.size());
+  for (size_t i = 0; i < input.size(); i++) {
+    // Only the last statement's value is the block's.
+    NodeId id = fold(input[i], used && i + 1 == input.size());
+    if (id != NO_NODE) {
+      ids.push_back(id);
+    }
+  }
+  return ids;
+}
+
+NodeList Folder::list(NodeList list) {
+  std::vector<NodeId> ids;
+  ids.reserve(list.size);
+  for (NodeId id : m_ast.list(list)) {
+    ids.push_back(fold(id, true));
+  }
+  return m_out.addList(ids);
+}
+
+NodeId Folder::prog(const ASTNode &node, bool used) {
+  std::vector<NodeId> body = statements(node.prog.body, used);
+  if (body.size() == 1) {
+    // A `let` keeps its block, which is its scope.
+    ASTType type = std::as_const(m_out).node(body[0]).type;
+    if (type != ASTType::VAR && type != ASTType::FUNCTION) {
+      return body[0];
+    }
+  }
+
+  ASTNode out = node;
+  out.prog.body = m_out.addList(body);
+  return emit(out, body.empty() ? Kind(ValueKind::INT) : kind(body.back()));
+}
+
+NodeId Folder::chain(NodeId id) {
+  size_t base = m_chain.size();
+  NodeId leaf = id;
+  for (; leaf != NO_NODE && m_ast.node(leaf).type == ASTType::BINARY; leaf = m_ast.node(leaf).binary.left) {
+    m_chain.push_back(Link{ leaf, NO_NODE });
+  }
+  // fold() counted the outermost.
+  m_visited += m_chain.size() - base - 1;
+
+  // The whole chain's output follows the mark, so an operator that folds
+  // away rewinds to it.
+  AST::Mark mark = m_out.mark();
+  NodeId left = fold(leaf, true);
+  while (m_chain.size() > base) {
+    const ASTNode &node = m_ast.node(m_chain.back().node);
+    m_chain.pop_back();
+    if (node.binary.op == Operator::AND || node.binary.op == Operator::OR) {
+      left = logical(node, left, mark);
+    } else {
+      left = binary(node, left, mark);
+    }
+  }
+  return left;
+}
+
+NodeId Folder::assign(NodeId id) {
+  size_t base = m_chain.size();
+  NodeId value = id;
+  for (; value != NO_NODE && m_ast.node(value).type == ASTType::ASSIGN; value = m_ast.node(value).binary.right) {
+    NodeId target = fold(m_ast.node(value).binary.left, true);
+    m_chain.push_back(Link{ value, target });
+  }
+  m_visited += m_chain.size() - base - 1;
+
+  value = fold(value, true);
+  while (m_chain.size() > base) {
+    ASTNode out = m_ast.node(m_chain.back().node);
+    out.binary.left = m_chain.back().target;
+    out.binary.right = value;
+    m_chain.pop_back();
+    value = emit(out, std::nullopt);
+  }
+  return value;
+}
+
+NodeId Folder::binary(const ASTNode &node, NodeId left, AST::Mark mark) {
+  Operator op = node.binary.op;
+  ASTNode out = node;
+  out.binary.left = left;
+  out.binary.right = fold(node.binary.right, true);
+
+  Constant l, r;
+  if (!constant(out.binary.left, l) || !constant(out.binary.right, r)) {
+    return emit(out, binaryKind(op, kind(out.binary.left), kind(out.binary.right)));
+  }
+
+  Constant result{ ValueKind::BOOL, Slot{ .i = 0 }, {} };
+  if (l.kind == ValueKind::STRING || r.kind == ValueKind::STRING) {
+    if (l.kind != r.kind || (op != Operator::EQ && op != Operator::NE)) {
+      return emit(out, std::nullopt);
+    }
+    result.value.i = (l.text == r.text) == (op == Operator::EQ);
+  } else if (l.kind == ValueKind::FLOAT || r.kind == ValueKind::FLOAT) {
+    double a = l.kind == ValueKind::FLOAT ? l.value.f : static_cast<double>(l.value.i);
+    double b = r.kind == ValueKind::FLOAT ? r.value.f : static_cast<double>(r.value.i);
+    switch (op) {
+    case Operator::ADD: result.value.f = a + b; break;
+    case Operator::SUB: result.value.f = a - b; break;
+    case Operator::MUL: result.value.f = a * b; break;
+    case Operator::DIV: result.value.f = a / b; break;
+    case Operator::MOD: result.value.f = std::fmod(a, b); break;
+    case Operator::EQ: result.value.i = a == b; break;
+    case Operator::NE: result.value.i = a != b; break;
+    case Operator::LT: result.value.i = a < b; break;
+    case Operator::GT: result.value.i = a > b; break;
+    case Operator::LE: result.value.i = a <= b; break;
+    case Operator::GE: result.value.i = a >= b; break;
+    default:
+      return emit(out, std::nullopt);
+    }
+    result.kind = isComparison(op) ? ValueKind::BOOL : ValueKind::FLOAT;
+  } else {
+    // As the VM computes them: wrapping, and a zero divisor left to fail at
+    // run time at its own position.
+    int64_t a = l.value.i, b = r.value.i;
+    auto wrap = [](uint64_t value) {
+      return static_cast<int64_t>(value);
+    };
+    result.kind = isComparison(op) ? ValueKind::BOOL : ValueKind::INT;
+    switch (op) {
+    case Operator::ADD: result.value.i = wrap(static_cast<uint64_t>(a) + static_cast<uint64_t>(b)); break;
+    case Operator::SUB: result.value.i = wrap(static_cast<uint64_t>(a) - static_cast<uint64_t>(b)); break;
+    case Operator::MUL: result.value.i = wrap(static_cast<uint64_t>(a) * static_cast<uint64_t>(b)); break;
+    case Operator::DIV:
+      if (b == 0) {
+        return emit(out, ValueKind::INT);
+      }
+      result.value.i = b == -1 ? wrap(0 - static_cast<uint64_t>(a)) : a / b;
+      break;
+    case Operator::MOD:
+      if (b == 0) {
+        return emit(out, ValueKind::INT);
+      }
+      result.value.i = b == -1 ? 0 : a % b;
+      break;
+    case Operator::EQ: result.value.i = a == b; break;
+    case Operator::NE: result.value.i = a != b; break;
+    case Operator::LT: result.value.i = a < b; break;
+    case Operator::GT: result.value.i = a > b; break;
+    case Operator::LE: result.value.i = a <= b; break;
+    case Operator::GE: result.value.i = a >= b; break;
+    default:
+      return emit(out, std::nullopt);
+    }
+  }
+
+  rewind(mark);
+  return emit(result, node);
+}
+
+NodeId Folder::logical(const ASTNode &node, NodeId left, AST::Mark mark) {
+  // The value that settles the operator on its own: false for &&, true
+  // for ||. The right operand of a settled one never runs.
+  bool settles = node.binary.op == Operator::OR;
+  ASTNode out = node;
+  out.binary.left = left;
+
+  Constant l, r;
+  bool known = constant(out.binary.left, l);
+  if (known && truthy(l) == settles) {
+    fold(node.binary.right, true);
+    rewind(mark);
+    return emit(Constant{ ValueKind::BOOL, Slot{ .i = settles }, {} }, node);
+  }
+  out.binary.right = fold(node.binary.right, true);
+  if (known && constant(out.binary.right, r)) {
+    bool value = truthy(r);
+    rewind(mark);
+    return emit(Constant{ ValueKind::BOOL, Slot{ .i = value }, {} }, node);
+  }
+  return emit(out, ValueKind::BOOL);
+}
+
+NodeId Folder::unary(const ASTNode &node) {
+  Operator op = node.unary.op;
+  AST::Mark mark = m_out.mark();
+  ASTNode out = node;
+  out.unary.operand = fold(node.unary.operand, true);
+  Kind result = unaryKind(op, kind(out.unary.operand));
+
+  Constant c;
+  if (!constant(out.unary.operand, c) || !result) {
+    return emit(out, result);
+  }
+  if (op == Operator::NOT) {
+    c.value.i = !truthy(c);
+  } else if (op == Operator::SUB) {
+    if (c.kind == ValueKind::FLOAT) {
+      c.value.f = -c.value.f;
+    } else {
+      c.value.i = static_cast<int64_t>(0 - static_cast<uint64_t>(c.value.i));
+    }
+  } else if (op != Operator::ADD) {
+    return emit(out, result);
+  }
+  c.kind = *result;
+
+  rewind(mark);
+  return emit(c, node);
+}
+
+NodeId Folder::branch(const ASTNode &node, bool used) {
+  AST::Mark mark = m_out.mark();
+  ASTNode out = node;
+  out.if_.cond = fold(node.if_.cond, true);
+  bool hasElse = node.if_.else_ != NO_NODE;
+
+  Constant c;
+  if (!constant(out.if_.cond, c)) {
+    out.if_.then = fold(node.if_.then, true);
+    out.if_.else_ = fold(node.if_.else_, true);
+    return emit(out, branchKind(kind(out.if_.then), kind(out.if_.else_), hasElse));
+  }
+
+  // Both branches are folded, each once, the taken one first; the other is
+  // dropped again unless the `if` turns out to need it for its kind.
+  bool taken = truthy(c);
+  ASTNode cond = std::as_const(m_out).node(out.if_.cond);
+  std::string text(c.text);
+  rewind(mark);
+
+  NodeId keep = taken ? node.if_.then : node.if_.else_;
+  NodeId drop = taken ? node.if_.else_ : node.if_.then;
+  if (!used) {
+    NodeId id = fold(keep, false);
+    AST::Mark after = m_out.mark();
+    fold(drop, false);
+    rewind(after);
+    return id;
+  }
+
+  AST::Mark before = m_out.mark();
+  NodeId id = fold(keep, true);
+  AST::Mark after = m_out.mark();
+  NodeId other = fold(drop, true);
+  Kind tk = taken ? kind(id) : kind(other);
+  Kind ek = taken ? kind(other) : kind(id);
+  Kind result = branchKind(tk, ek, hasElse);
+  if (result) {
+    if (id == NO_NODE) {
+      rewind(before);
+      Constant zero{ *result, Slot{ .i = 0 }, {} };
+      if (*result == ValueKind::FLOAT) {
+        zero.value.f = 0.0;
+      }
+      return emit(zero, node);
+    }
+    if (kind(id) == result) {
+      rewind(after);
+      return id;
+    }
+    // A literal can take the kind itself.
+    Constant k;
+    if (constant(id, k)) {
+      if (*result == ValueKind::FLOAT) {
+        k.value.f = static_cast<double>(k.value.i);
+      }
+      k.kind = *result;
+      ASTNode at = std::as_const(m_out).node(id);
+      rewind(before);
+      return emit(k, at);
+    }
+  }
+
+  // The kind cannot be settled here, so the `if` stays, with the dropped
+  // branch after all.
+  c.text = text;
+  out.if_.cond = emit(c, cond);
+  out.if_.then = taken ? id : other;
+  out.if_.else_ = taken ? other : id;
+  return emit(out, branchKind(kind(out.if_.then), kind(out.if_.else_), hasElse));
+}
+
+NodeId Folder::emit(const ASTNode &node, Kind kind) {
+  m_kinds.push_back(kind);
+  return m_out.add(node);
+}
+
+NodeId Folder::emit(const Constant &constant, const ASTNode &at) {
+  ASTNode node;
+  node.offset = at.offset;
+  switch (constant.kind) {
+  case ValueKind::INT:
+    node.type = ASTType::INTEGER;
+    node.integer = constant.value.i;
+    break;
+  case ValueKind::FLOAT:
+    node.type = ASTType::FLOAT;
+    node.real = constant.value.f;
+    break;
+  case ValueKind::BOOL:
+    node.type = ASTType::BOOL;
+    node.boolean = constant.value.i != 0;
+    break;
+  case ValueKind::CHAR:
+    node.type = ASTType::CHAR;
+    node.character = static_cast<char>(constant.value.i);
+    break;
+  case ValueKind::STRING:
+    node.type = ASTType::STRING;
+    node.string = m_out.addString(constant.text);
+    break;
+  }
+  return emit(node, constant.kind);
+}
+
+bool Folder::constant(NodeId id, Constant &out) const {
+  if (id == NO_NODE) {
+    return false;
+  }
+  const ASTNode &node = m_out.node(id);
+  out.text = {};
+  switch (node.type) {
+  case ASTType::INTEGER:
+    out.kind = ValueKind::INT;
+    out.value.i = node.integer;
+    return true;
+  case ASTType::FLOAT:
+    out.kind = ValueKind::FLOAT;
+    out.value.f = node.real;
+    return true;
+  case ASTType::BOOL:
+    out.kind = ValueKind::BOOL;
+    out.value.i = node.boolean;
+    return true;
+  case ASTType::CHAR:
+    out.kind = ValueKind::CHAR;
+    out.value.i = static_cast<unsigned char>(node.character);
+    return true;
+  case ASTType::STRING:
+    out.kind = ValueKind::STRING;
+    out.value.i = 0;
+    out.text = m_out.string(node.string);
+    return true;
+  default:
+    return false;
+  }
+}
+
+void Folder::rewind(AST::Mark mark) {
+  m_out.rewind(mark);
+  m_kinds.resize(mark.nodes);
+}
+
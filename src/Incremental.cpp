@@ -0,0 +1,190 @@
+#include "Incremental.h"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+// A top-level form ends with its '\n' token and the parser never looks
+// further ahead than that, so a form's tree depends only on its own tokens.
+// An edit therefore invalidates just the forms whose span it touches, and
+// re-parsing can stop at the first form boundary past the edit that lines up
+// with an old one: from there on the text, and so the forms, are unchanged.
+
+// A parse with syntax errors leaves the tree as it was; the first error is
+// thrown, as every other failure of this class is.
+static void throwFirstError(const Parser &parser, std::string_view text) {
+  if (!parser.diagnostics().empty()) {
+    throw std::runtime_error(Diagnostics::format(parser.diagnostics()[0], SourceMap(text)));
+  }
+}
+
+void IncrementalParser::reset(std::string text) {
+  m_text = std::move(text);
+  reparse();
+}
+
+void IncrementalParser::reparse() {
+  m_valid = false;
+
+  AST ast;
+  std::vector<Form> forms;
+  std::vector<uint32_t> bases{ 0 };
+  std::vector<NodeId> body;
+  Lexer lexer(std::string_view(m_text), m_symbols);
+  Parser parser(lexer);
+
+  Token first = parser.currentToken();
+  ASTNode root;
+  root.type = ASTType::PROG;
+  root.offset = first.start();
+  ast.setRoot(ast.add(root));
+
+  while (parser.currentToken() != TokenType::EOB) {
+    Form form = parseForm(parser, ast, static_cast<uint32_t>(bases.size()));
+    bases.push_back(form.start);
+    forms.push_back(form);
+    body.push_back(form.node);
+  }
+  throwFirstError(parser, m_text);
+  ast.node(ast.root()).prog.body = ast.addList(body);
+
+  m_ast = std::move(ast);
+  m_forms = std::move(forms);
+  m_bases = std::move(bases);
+  m_formOf.assign(m_ast.size(), 0);
+  for (auto &form : m_forms) {
+    std::fill(m_formOf.begin() + form.firstNode, m_formOf.begin() + form.lastNode, form.id);
+  }
+  m_deadNodes = 0;
+  m_valid = true;
+}
+
+IncrementalParser::Form IncrementalParser::parseForm(Parser &parser, AST &ast, uint32_t id) {
+  Form form{ parser.currentToken().start(), 0, id, NO_NODE, static_cast<NodeId>(ast.size()), 0 };
+  form.node = parser.parseForm(ast);
+  form.lastNode = static_cast<NodeId>(ast.size());
+  form.end = parser.currentToken().start();
+  for (NodeId node = form.firstNode; node < form.lastNode; node++) {
+    ast.node(node).offset -= form.start;
+  }
+  return form;
+}
+
+void IncrementalParser::update(const std::vector<TextEdit> &edits) {
+  if (edits.empty()) {
+    return;
+  }
+
+  std::vector<const TextEdit *> sorted;
+  for (auto &edit : edits) {
+    sorted.push_back(&edit);
+  }
+  std::sort(sorted.begin(), sorted.end(), [](const TextEdit *a, const TextEdit *b) {
+    return a->offset < b->offset;
+  });
+
+  // Edits are applied back to front so the offsets still to come stay valid.
+  // Together they can only have changed the old text in [lo, hi).
+  uint32_t lo = sorted.front()->offset;
+  uint32_t hi = 0;
+  int64_t delta = 0;
+  for (size_t i = 0; i < sorted.size(); i++) {
+    auto &edit = *sorted[i];
+    uint32_t end = edit.offset + edit.length;
+    if (end > m_text.size() || (i + 1 < sorted.size() && end > sorted[i + 1]->offset)) {
+      throw std::runtime_error("Edit at " + std::to_string(edit.offset) + " is out of range or overlaps another");
+    }
+    hi = std::max(hi, end);
+    delta += static_cast<int64_t>(edit.text.size()) - edit.length;
+  }
+  for (auto it = sorted.rbegin(); it != sorted.rend(); it++) {
+    m_text.replace((*it)->offset, (*it)->length, (*it)->text);
+  }
+
+  if (!m_valid || m_forms.empty()) {
+    reparse();
+    return;
+  }
+  m_valid = false;
+
+  // First form the edits reach into. An edit past the last form re-parses
+  // that form too, which keeps a known position to start lexing from.
+  auto firstIt = std::upper_bound(m_forms.begin(), m_forms.end(), lo, [](uint32_t lo, const Form &form) {
+    return lo < form.end;
+  });
+  size_t first = std::min<size_t>(firstIt - m_forms.begin(), m_forms.size() - 1);
+
+  // Lexing restarts at the beginning of the form's line, just after the
+  // previous form's '\n', since a comment there may now run into the form.
+  // Text before the first form belongs to no form, so an edit there
+  // restarts from offset 0.
+  Lexer lexer(std::string_view(m_text), m_symbols);
+  if (first > 0) {
+    auto newline = static_cast<const char *>(::memrchr(m_text.data(), '\n', m_forms[first].start));
+    lexer.seek(static_cast<uint32_t>(newline + 1 - m_text.data()));
+  }
+  Parser parser(lexer);
+
+  std::vector<Form> fresh;
+  size_t resume = m_forms.size();
+  int64_t at = 0;
+  for (size_t k = first; ; ) {
+    Token tok = parser.currentToken();
+    at = tok.start();
+
+    while (k < m_forms.size() && (m_forms[k].start < hi || m_forms[k].start + delta < at)) {
+      k++;
+    }
+    if (k < m_forms.size() && m_forms[k].start + delta == at) {
+      resume = k;
+      break;
+    }
+    if (tok == TokenType::EOB) {
+      break;
+    }
+
+    Form form = parseForm(parser, m_ast, static_cast<uint32_t>(m_bases.size()));
+    m_bases.push_back(form.start);
+    m_formOf.resize(form.lastNode, form.id);
+    fresh.push_back(form);
+  }
+  throwFirstError(parser, m_text);
+
+  for (size_t i = first; i < resume; i++) {
+    m_deadNodes += m_forms[i].lastNode - m_forms[i].firstNode;
+  }
+  // Moving a form moves its nodes with it.
+  for (size_t i = resume; i < m_forms.size(); i++) {
+    auto &form = m_forms[i];
+    form.start += delta;
+    form.end += delta;
+    m_bases[form.id] = form.start;
+  }
+  // Fresh forms take the places of old ones where they can, so only a change
+  // in their number moves the forms after them.
+  size_t common = std::min(fresh.size(), resume - first);
+  std::copy(fresh.begin(), fresh.begin() + common, m_forms.begin() + first);
+  m_forms.erase(m_forms.begin() + first + common, m_forms.begin() + resume);
+  m_forms.insert(m_forms.begin() + first + common, fresh.begin() + common, fresh.end());
+  if (first > 0) {
+    // Whatever now follows the last untouched form, whitespace included,
+    // starts where its span ends.
+    m_forms[first - 1].end = fresh.empty() ? at : fresh.front().start;
+  }
+
+  // Garbage outweighs the live tree, or there is no form left to take the
+  // root's position from: rebuild from scratch.
+  if (m_forms.empty() || m_deadNodes * 2 > m_ast.size()) {
+    reparse();
+    return;
+  }
+  std::vector<NodeId> nodes;
+  nodes.reserve(fresh.size());
+  for (auto &form : fresh) {
+    nodes.push_back(form.node);
+  }
+  auto &root = m_ast.node(m_ast.root());
+  root.offset = m_forms.front().start;
+  root.prog.body = m_ast.spliceList(root.prog.body, first, resume - first, nodes);
+  m_valid = true;
+}
\ No newline at end of file
@@ -1,4 +1,9 @@
 #include "Lexer.h"
+#include "TokenBuffer.h"
+
+#include <algorithm>
+#include <charconv>
+#include <string>
 
 const std::unordered_map<TokenType, std::string> Token::typeNames = {
   {TokenType::NONE, "NONE"},
@@ -11,117 +16,106 @@ const std::unordered_map<TokenType, std::string> Token::typeNames = {
   {TokenType::CHAR, "CHAR"},
   {TokenType::OPERATOR, "OPERATOR"},
   {TokenType::PUNCTUATOR, "PUNCTUATOR"},
+  {TokenType::INVALID, "INVALID"},
 };
 
-UnexpectedCharacterException::UnexpectedCharacterException(char c, uint32_t row, uint32_t col) {
-  std::stringstream ss;
-  ss << "Unexpected character '" << c << "' @ (" << row << ", " << col << ")";
-  m_message = ss.str();
-}
-
-std::unordered_map<char, char> escapeMap = {
-  { 'a', '\a' },
-  { 'b', '\b' },
-  { 'f', '\f' },
-  { 'n', '\n' },
-  { 'r', '\r' },
-  { 't', '\t' },
-  { 'v', '\v' },
-  { '\\', '\\' },
-  { '\'', '\'' },
-  { '\"', '\"' },
-  { '?', '\?' },
-};
+Lexer::Lexer(Source source, SymbolTable &symbols) : m_source(std::move(source)), m_symbols(symbols) {
+  m_begin = m_cur = m_source.data();
+  m_end = m_begin + m_source.size();
+  m_currentToken = Token{};
+}
+
+Lexer::Lexer(std::basic_istream<char> &stream, SymbolTable &symbols) : Lexer(Source(stream), symbols) { }
 
-Lexer::Lexer(std::basic_istream<char> &stream) {
-  m_data.clear();
-  m_data << stream.rdbuf();
-  m_currentToken = Token{ TokenType::NONE, "", 0, 0 };
+Lexer::Lexer(std::string_view buffer, SymbolTable &symbols) : Lexer(Source(buffer), symbols) { }
+
+void Lexer::seek(uint32_t offset) {
+  m_cur = m_begin + offset;
+  m_currentToken = Token{};
 }
 
 char Lexer::peekChar() {
-  return m_data.peek();
+  return m_cur != m_end ? *m_cur : EOF;
 }
 
 char Lexer::nextChar() {
-  char c = m_data.get();
-  if (c == '\n') {
-    m_row++;
-    m_lastLineCol = m_col;
-    m_col = 0;
-  } else {
-    m_col++;
+  if (m_cur == m_end) {
+    return EOF;
   }
-  return c;
+  return *m_cur++;
 }
 
 void Lexer::putBackChar() {
-  m_data.unget();
-  if (m_col == 0) {
-    m_row--;
-    m_col = m_lastLineCol;
-  } else {
-    m_col--;
-  }
+  m_cur--;
 }
 
 bool Lexer::eof() {
-  return peekChar() == EOF;
+  return m_cur == m_end;
+}
+
+void Lexer::skipTo(const char *to) {
+  m_cur = to;
 }
 
 void Lexer::skipWhitespace() {
-  readWhile(&isWhitespace);
+  skipTo(scanWhitespace(m_cur, m_end));
 }
 
 void Lexer::skipComment() {
-  readWhile([](const char *c) { return *c != '\n'; });
+  skipTo(scanLine(m_cur, m_end));
 }
 
-std::string Lexer::readWhile(std::function<bool(const char *)> predicate) {
-  std::string result;
-  char cs[2];
-  cs[0] = peekChar();
-  cs[1] = '\0';
-   
-  while (!eof() && predicate(cs)) {
-    result += nextChar();
-    cs[0] = peekChar();
+std::string_view Lexer::readEscaped(char end, uint32_t &escaped) {
+  // Only the closing quote and backslashes stop the scan. Escapes are just
+  // stepped over here; decoding waits until someone asks for the value.
+  const char *start = m_cur;
+  const char *p = scanLiteral(m_cur, m_end, end);
+  escaped = 0;
+  while (p != m_end && *p != end) {
+    escaped = 1;
+    p = std::min(p + 2, m_end);
+    p = scanLiteral(p, m_end, end);
   }
-  return result;
-}
-
-std::string Lexer::readEscaped(char end) {
-  std::string result;
-  char cs[2];
-  cs[1] = '\0';
+  skipTo(p);
+  std::string_view raw(start, p - start);
+  if (p == m_end) {
+    escaped = literal::UNTERMINATED;
+    return raw;
+  }
+  nextChar();
 
-  bool esc = false;
+  if (escaped != 0) {
+    m_escaped.push_back(Escaped{ offset(start), static_cast<uint32_t>(raw.size()), std::nullopt });
+    escaped = static_cast<uint32_t>(m_escaped.size());
+  }
+  return raw;
+}
 
-  while (!eof()) {
-    cs[0] = nextChar();
-    if (esc) {
-      if (escapeMap.find(cs[0]) != escapeMap.end()) {
-        result += escapeMap[cs[0]];
-      } else {
-        result += cs[0];
+std::string_view Lexer::cooked(uint32_t id) const {
+  Escaped &literal = m_escaped[id - 1];
+  if (!literal.value) {
+    std::string_view raw = text(literal.offset, literal.length);
+    std::string &value = literal.value.emplace();
+    value.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); ) {
+      size_t backslash = std::min(raw.find('\\', i), raw.size());
+      value.append(raw, i, backslash - i);
+      if (backslash + 1 >= raw.size()) {
+        break;
       }
-      esc = false;
-    } else if (cs[0] == '\\') {
-      esc = true;
-    } else if (cs[0] == end) {
-      break;
-    } else {
-      result += cs[0];
+      char c = raw[backslash + 1];
+      char decoded = ESCAPE_VALUES[static_cast<unsigned char>(c)];
+      value += decoded != 0 ? decoded : c;
+      i = backslash + 2;
     }
   }
-
-  return result;
+  return *literal.value;
 }
 
 Token Lexer::readNextToken() {
   skipWhitespace();
   if (eof()) {
-    return Token{ TokenType::EOB, "", m_row, m_col };
+    return Token{ TokenType::EOB, "", 0, offset(m_cur) };
   }
 
   if (peekChar() == '/') {
@@ -134,69 +128,179 @@ Token Lexer::readNextToken() {
     }
   }
 
-  char cs[2];
-  cs[0] = peekChar();
-  cs[1] = '\0';
+  char c = peekChar();
 
-  if (isDigit(cs)) {
+  if (isDigit(c)) {
     return readNumberToken();
   }
-  if (isIdentifier(cs)) {
+  if (isIdentifier(c)) {
     return readIdentifierToken();
   }
-  if (isStringQuote(cs)) {
-    auto row = m_row, col = m_col;
-    nextChar();
-    return Token{ TokenType::STRING, readEscaped('"'), row, col };
+  if (isStringQuote(c)) {
+    return readLiteralToken(TokenType::STRING, '"');
   }
-  if (isCharQuote(cs)) {
-    auto row = m_row, col = m_col;
-    nextChar();
-    return Token{ TokenType::CHAR, readEscaped('\''), row, col };
+  if (isCharQuote(c)) {
+    return readLiteralToken(TokenType::CHAR, '\'');
   }
-  if (isOperator(cs)) {
-    auto row = m_row, col = m_col;
-    return Token{ TokenType::OPERATOR, readWhile(&isOperator), row, col };
+  if (isOperator(c)) {
+    size_t length;
+    Operator op = matchOperator(std::string_view(m_cur, m_end - m_cur), length);
+    if (op == Operator::NONE) {
+      return readInvalidToken();
+    }
+    std::string_view value(m_cur, length);
+    skipTo(m_cur + length);
+    return Token{ TokenType::OPERATOR, value, static_cast<uint32_t>(op), offset(value.data()) };
   }
-  if (isPunctuator(cs)) {
-    auto row = m_row, col = m_col;
-    return Token{ TokenType::PUNCTUATOR, std::string(1, nextChar()), row, col };
+  if (isPunctuator(c)) {
+    std::string_view value(m_cur, 1);
+    nextChar();
+    return Token{ TokenType::PUNCTUATOR, value, 0, offset(value.data()) };
+  }
+
+  return readInvalidToken();
+}
+
+Token Lexer::readInvalidToken() {
+  std::string_view value(m_cur, 1);
+  nextChar();
+  return Token{ TokenType::INVALID, value, 0, offset(value.data()) };
+}
+
+// Digits of `base`, with single '_' separators between them. Returns the
+// end of the run; `ok` is cleared if it has no digits or a stray separator.
+static const char *scanDigits(const char *p, const char *end, int base, bool &ok, bool &separated) {
+  auto digit = [base](char c) {
+    switch (base) {
+    case 2: return c == '0' || c == '1';
+    case 16: return isDigit(c) || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+    default: return isDigit(c);
+    }
+  };
+  const char *start = p;
+  while (p != end && (digit(*p) || *p == '_')) {
+    if (*p == '_') {
+      separated = true;
+      ok = ok && p != start && p + 1 != end && digit(p[1]);
+    }
+    p++;
   }
-  
-  throw UnexpectedCharacterException(*cs, m_row, m_col);
+  ok = ok && p != start;
+  return p;
 }
 
 Token Lexer::readNumberToken() {
-  auto row = m_row, col = m_col;
-  bool dot = false;
-  std::string value = readWhile([&dot](const char *c) {
-    if (*c == '.') {
-      if (dot) {
-        return false;
-      }
-      dot = true;
-      return true;
+  const char *start = m_cur;
+  const char *p = m_cur;
+  bool ok = true, separated = false, real = false;
+
+  int base = 10;
+  if (p[0] == '0' && p + 1 != m_end && ((p[1] | 0x20) == 'x' || (p[1] | 0x20) == 'b')) {
+    base = (p[1] | 0x20) == 'x' ? 16 : 2;
+    p += 2;
+  }
+  const char *digits = p;
+  p = scanDigits(p, m_end, base, ok, separated);
+  if (base == 10 && p != m_end && *p == '.') {
+    real = true;
+    if (++p != m_end && isDigit(*p)) {
+      p = scanDigits(p, m_end, base, ok, separated);
+    }
+  }
+  if (base == 10 && p != m_end && (*p | 0x20) == 'e') {
+    real = true;
+    if (++p != m_end && (*p == '+' || *p == '-')) {
+      p++;
     }
-    return isDigit(c);
-  });
+    p = scanDigits(p, m_end, base, ok, separated);
+  }
+  // `12ab` or `0x1g` is one bad literal rather than a number and a name.
+  if (p != m_end && isIdentifier(*p)) {
+    ok = false;
+    p = scanIdentifier(p, m_end);
+  }
+  skipTo(p);
 
-  return Token{ dot ? TokenType::FLOAT : TokenType::INTEGER, value, row, col };
+  std::string_view value(start, p - start);
+  uint32_t id = ok ? readNumber(std::string_view(digits, p - digits), base, real, separated) : number::MALFORMED;
+  return Token{ real ? TokenType::FLOAT : TokenType::INTEGER, value, id, offset(start) };
+}
+
+uint32_t Lexer::readNumber(std::string_view digits, int base, bool real, bool separated) {
+  // from_chars takes no separators, so those literals are read from a copy
+  // without them; only one too long for the buffer needs the heap.
+  char buffer[128];
+  std::string spill;
+  if (separated) {
+    char *out = buffer;
+    if (digits.size() > sizeof(buffer)) {
+      spill.resize(digits.size());
+      out = spill.data();
+    }
+    char *last = std::remove_copy(digits.begin(), digits.end(), out, '_');
+    digits = std::string_view(out, last - out);
+  }
+
+  const char *first = digits.data(), *last = digits.data() + digits.size();
+  Number number;
+  std::from_chars_result result;
+  if (real) {
+    result = std::from_chars(first, last, number.real);
+  } else if (base == 10) {
+    result = std::from_chars(first, last, number.integer);
+  } else {
+    // Hex and binary spell bit patterns, so all 64 bits are theirs.
+    uint64_t bits = 0;
+    result = std::from_chars(first, last, bits, base);
+    number.integer = static_cast<int64_t>(bits);
+  }
+  if (result.ec == std::errc::result_out_of_range) {
+    return number::OUT_OF_RANGE;
+  }
+  if (result.ec != std::errc() || result.ptr != last) {
+    return number::MALFORMED;
+  }
+  m_numbers.push_back(number);
+  return static_cast<uint32_t>(m_numbers.size());
+}
+
+Token Lexer::readLiteralToken(TokenType type, char end) {
+  nextChar();
+  auto start = offset(m_cur);
+  uint32_t cooked;
+  auto value = readEscaped(end, cooked);
+  return Token{ type, value, cooked, start };
 }
 
 Token Lexer::readIdentifierToken() {
-  auto row = m_row, col = m_col;
-  std::string value = readWhile(&isIdentifier);
+  const char *start = m_cur;
+  skipTo(scanIdentifier(m_cur, m_end));
+  std::string_view value(start, m_cur - start);
 
-  if (isKeyword(value.c_str())) {
-    return Token{ TokenType::KEYWORD, value, row, col };
+  if (Keyword kw = findKeyword(value); kw != Keyword::NONE) {
+    return Token{ TokenType::KEYWORD, value, static_cast<uint32_t>(kw), offset(start) };
   }
 
-  return Token{ TokenType::IDENTIFIER, value, row, col };
+  return Token{ TokenType::IDENTIFIER, value, m_symbols.intern(value).id, offset(start) };
+}
+
+void Lexer::tokenize(TokenBuffer &tokens) {
+  tokens.attach(*this);
+  if (m_currentToken.type != TokenType::NONE) {
+    tokens.push(nextToken());
+  }
+  while (true) {
+    Token tok = readNextToken();
+    tokens.push(tok);
+    if (tok == TokenType::EOB) {
+      break;
+    }
+  }
 }
 
 Token Lexer::nextToken() {
   auto tok = currentToken();
-  m_currentToken = Token{TokenType::NONE, "", 0, 0};
+  m_currentToken = Token{};
   return tok;
 }
 
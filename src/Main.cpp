@@ -1,22 +1,253 @@
+#include <charconv>
+#include <cstring>
 #include <iostream>
-#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
 
-#include "Parser.h"
+#include "Allocs.h"
+#include "Compiler.h"
+#include "Counters.h"
+#include "Driver.h"
+#include "Folder.h"
+#include "Server.h"
+#include "StreamParser.h"
+#include "Trace.h"
+#include "VM.h"
 
-int main() {
+// The whole of `text` as a number; false for anything else, sign included.
+template <typename T>
+static bool parseNumber(std::string_view text, T &value) {
+  auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+  return ec == std::errc() && end == text.data() + text.size();
+}
 
-  std::ifstream file("./test.txt");
+int main(int argc, char **argv) {
+  DriverOptions options;
+  bool debug = false;
+  bool run = false;
+  bool bytecode = false;
+  bool fold = false;
+  bool json = false; // --counters json rather than table
+  std::string serve; // --serve socket path
+  allocs::Budget budget;
+  std::vector<std::string> paths;
 
-  Lexer lexer(file);
-  Parser parser(lexer);
+  for (int i = 1; i < argc; i++) {
+    if (std::strcmp(argv[i], "-j") == 0) {
+      if (i + 1 == argc || !parseNumber(argv[++i], options.jobs)) {
+        std::cerr << "-j takes a number of threads" << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--max-depth") == 0) {
+      if (i + 1 == argc || !parseNumber(argv[++i], options.maxDepth)) {
+        std::cerr << "--max-depth takes a number of levels" << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+      serve = argv[++i];
+    } else if (std::strcmp(argv[i], "--cache") == 0 && i + 1 < argc) {
+      options.cacheDir = argv[++i];
+    } else if (std::strcmp(argv[i], "--counters") == 0 && i + 1 < argc) {
+      std::string format = argv[++i];
+      if (format != "table" && format != "json") {
+        std::cerr << "--counters takes table or json" << std::endl;
+        return 1;
+      }
+      options.profile = true;
+      json = format == "json";
+    } else if (std::strcmp(argv[i], "--alloc-budget") == 0 && i + 1 < argc) {
+      if (!allocs::ENABLED) {
+        std::cerr << "--alloc-budget needs a build with SKWIRL_ALLOCS=1 (make allocs)" << std::endl;
+        return 1;
+      }
+      if (!budget.parse(argv[++i])) {
+        std::cerr << "--alloc-budget takes per-token=N, per-node=N, bytes=N or peak=N" << std::endl;
+        return 1;
+      }
+    } else if (std::strcmp(argv[i], "--debug") == 0) {
+      debug = true;
+    } else if (std::strcmp(argv[i], "--run") == 0) {
+      run = true;
+    } else if (std::strcmp(argv[i], "--bytecode") == 0) {
+      bytecode = true;
+    } else if (std::strcmp(argv[i], "--fold") == 0) {
+      fold = true;
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (!serve.empty()) {
+    // Answers parse and check requests until a client asks it to shut down,
+    // then reports their latencies on stderr.
+    try {
+      Server server(serve, options);
+      server();
+      server.printStats(std::cerr);
+    } catch (const std::exception &e) {
+      std::cerr << e.what() << std::endl;
+      return 1;
+    }
+    return 0;
+  }
+  if (paths.empty()) {
+    paths.push_back("./test.txt");
+  }
 
-  // while (lexer.currentToken() != TokenType::EOB) {
-  //   std::cout << lexer.nextToken() << std::endl;
-  // }
+  // In a `make allocs` build, everything from here on is charged to the run:
+  // finish() reports it on stderr, measured against the tokens and nodes of
+  // every file parsed, and fails a run over budget.
+  allocs::reset();
+  uint64_t tokens = 0;
+  uint64_t nodes = 0;
+  auto finish = [&](int status) {
+    if (!allocs::ENABLED) {
+      return status;
+    }
+    allocs::Totals totals = allocs::totals();
+    allocs::print(std::cerr, totals, tokens, nodes);
+    return allocs::exceeds(std::cerr, totals, tokens, nodes, budget) ? 1 : status;
+  };
 
-  AST ast = parser();
-  std::cout << ast << std::endl;
+  // Constant-folds a parsed file, reporting how much it shrank on stderr.
+  auto optimize = [fold, &options](ParseResult &result) {
+    if (!fold) {
+      return;
+    }
+    counters::Scope scope(options.profile ? &result.profile : nullptr, counters::Phase::FOLD);
+    ALLOC_SITE(FOLD);
+    Folder folder(result.ast);
+    result.ast = folder();
+    std::cerr << result.path << ": folded away " << folder.removed() << " nodes" << std::endl;
+  };
+  // With --counters, writes a file's profile to stderr once it is done with.
+  auto profile = [json, &options](const ParseResult &result) {
+    if (!options.profile) {
+      return;
+    }
+    if (json) {
+      result.profile.printJson(std::cerr, result.path);
+    } else {
+      result.profile.printTable(std::cerr, result.path);
+    }
+  };
 
+  if (debug) {
+    // One file at a time, each followed by its trace (empty unless built
+    // with `make trace`).
+    for (auto &path : paths) {
+      trace::clear();
+      try {
+        SymbolTable symbols;
+        Lexer lexer(Source::mapFile(path), symbols);
+        Parser parser(lexer, options.mode);
+        parser.setMaxDepth(options.maxDepth);
 
-  return 0;
-}
\ No newline at end of file
+        AST ast = parser();
+        tokens += parser.tokens();
+        nodes += ast.size();
+        trace::dump(std::cout);
+        if (!parser.diagnostics().empty()) {
+          parser.diagnostics().print(std::cerr, path, SourceMap(lexer.source()));
+          return finish(1);
+        }
+        std::cout << ast << std::endl;
+      } catch (const std::exception &e) {
+        trace::dump(std::cout);
+        std::cerr << path << ": " << e.what() << std::endl;
+        return finish(1);
+      }
+    }
+    return finish(0);
+  }
+
+  if (run || bytecode) {
+    for (auto &path : paths) {
+      ParseResult result = parseFile(path, options.mode, nullptr, options.profile, options.maxDepth);
+      tokens += result.tokens;
+      nodes += result.ast.size();
+      if (!result.ok()) {
+        result.report(std::cerr);
+        profile(result);
+        return finish(1);
+      }
+      counters::Profile *counted = options.profile ? &result.profile : nullptr;
+      try {
+        optimize(result);
+        Semantics semantics;
+        {
+          counters::Scope scope(counted, counters::Phase::RESOLVE);
+          ALLOC_SITE(RESOLVE);
+          semantics = Resolver(result.ast, result.symbols)(options.jobs);
+        }
+        Program program;
+        {
+          counters::Scope scope(counted, counters::Phase::COMPILE);
+          ALLOC_SITE(COMPILE);
+          Compiler compiler(result.ast, result.symbols, semantics);
+          program = compiler();
+        }
+        if (bytecode) {
+          std::cout << program;
+        }
+        if (run) {
+          ALLOC_SITE(RUN);
+          VM vm(program, std::cout);
+          Slot value;
+          {
+            counters::Scope scope(counted, counters::Phase::RUN);
+            value = vm.run();
+          }
+          std::cout << path << ": ";
+          printValue(std::cout, program, value, program.functions[program.main].result);
+          std::cout << std::endl;
+        }
+      } catch (const SourceError &e) {
+        std::cerr << path << ": " << e.what() << " at " << SourceMap(result.source.view()).locate(e.offset()) << std::endl;
+        profile(result);
+        return finish(1);
+      } catch (const std::exception &e) {
+        std::cerr << path << ": " << e.what() << std::endl;
+        profile(result);
+        return finish(1);
+      }
+      profile(result);
+    }
+    return finish(0);
+  }
+
+  if (paths.size() == 1 && paths[0] == "-") {
+    // Standard input may never end, so report statements as they complete.
+    SymbolTable symbols;
+    StreamParser parser(std::cin, symbols);
+    int status = 0;
+    try {
+      parser([](const AST &ast) {
+        std::cout << "-: " << ast << std::endl;
+      }, [&status](const Diagnostic &diagnostic, const SourceMap &source) {
+        std::cerr << "-: " << Diagnostics::format(diagnostic, source) << std::endl;
+        status = 1;
+      });
+    } catch (const std::exception &e) {
+      std::cerr << "-: " << e.what() << std::endl;
+      return 1;
+    }
+    return status;
+  }
+
+  int status = 0;
+  for (auto &result : parseFiles(paths, options)) {
+    tokens += result.tokens;
+    nodes += result.ast.size();
+    if (result.ok()) {
+      optimize(result);
+      std::cout << result.path << ": " << result.ast << std::endl;
+    } else {
+      result.report(std::cerr);
+      status = 1;
+    }
+    profile(result);
+  }
+
+  return finish(status);
+}
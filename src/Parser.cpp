@@ -1,317 +1,751 @@
 #include "Parser.h"
 
-#include <iostream>
-using std::cout, std::endl;
-
-const std::unordered_map<std::string, uint32_t> OPERATOR_PRECEDENCE = {
-  {"=", 1},
-  {"<", 7}, {">", 7}, {"<=", 7}, {">=", 7}, {"==", 7}, {"!=", 7},
-  {"+", 10}, {"-", 10},
-  {"*", 20}, {"/", 20}, {"%", 20}, 
-};
+#include "Allocs.h"
+#include "Trace.h"
+
+Parser::Parser(Lexer &lexer, TokenMode mode) : m_lexer(lexer), m_tokens(lexer, mode) { }
+
+NodeId Parser::parseForm(AST &ast) {
+  std::swap(m_ast, ast);
+  NodeId form = NO_NODE;
+  if (m_tokens.type() != TokenType::EOB) {
+    form = parseStatement();
+    if (m_panic) {
+      synchronize(false);
+    }
+    m_tokens.release();
+  }
+  std::swap(m_ast, ast);
+  return form;
+}
 
-Parser::Parser(Lexer &lexer) : m_lexer(lexer) { }
+Token Parser::currentToken() {
+  return m_tokens.token();
+}
 
 AST Parser::operator()() {
-  return parseToplevel();
+  m_ast.clear();
+  m_ast.setRoot(parseToplevel());
+  return std::move(m_ast);
+}
+
+void Parser::operator()(AST &ast) {
+  std::swap(m_ast, ast);
+  m_ast.clear();
+  m_ast.setRoot(parseToplevel());
+  std::swap(m_ast, ast);
+}
+
+bool Parser::isTokenKeyword(Keyword keyword) {
+  return m_tokens.type() == TokenType::KEYWORD && (keyword == Keyword::NONE || m_tokens.keyword() == keyword);
+}
+
+bool Parser::isTokenOperator(Operator op) {
+  return m_tokens.type() == TokenType::OPERATOR && (op == Operator::NONE || m_tokens.op() == op);
+}
+
+bool Parser::isTokenPunctuator(std::string_view value) {
+  return m_tokens.type() == TokenType::PUNCTUATOR && (value.size() == 0 || m_tokens.value() == value);
+}
+
+size_t Parser::nextToken() {
+  size_t i = m_tokens.index();
+  m_tokens.advance();
+  return i;
+}
+
+void Parser::error(DiagnosticCode code, size_t tok, uint32_t arg) {
+  if (m_panic) {
+    return;
+  }
+  m_panic = true;
+  const auto &tokens = m_tokens.buffer();
+  if (tokens.type(tok) == TokenType::INVALID) {
+    // Whatever was expected, the lexer's complaint comes first.
+    code = DiagnosticCode::UNEXPECTED_CHARACTER;
+    arg = static_cast<unsigned char>(tokens.value(tok)[0]);
+  }
+  Diagnostic diagnostic{ code, arg, tokens.start(tok), tokens.length(tok) };
+  // A block left open at the end of input is reported once, not once per
+  // enclosing block.
+  if (!m_diagnostics.empty() && m_diagnostics.back().offset == diagnostic.offset) {
+    return;
+  }
+  m_diagnostics.report(diagnostic);
 }
 
-std::string escapeChar(char c) {
-  for (auto kv : escapeMap) {
-    if (kv.second == c) {
-      return "\\" + std::string(1, kv.first);
+NodeId Parser::fail(DiagnosticCode code, uint32_t arg) {
+  size_t tok = m_tokens.index();
+  error(code, tok, arg);
+  return addNode(ASTType::NONE, tok);
+}
+
+void Parser::synchronize(bool block) {
+  size_t depth = 0;
+  while (m_tokens.type() != TokenType::EOB) {
+    switch (m_tokens.keyword()) {
+    case Keyword::BEGIN:
+    case Keyword::DO:
+    case Keyword::THEN:
+      depth++;
+      break;
+    case Keyword::END:
+      if (depth == 0 && block) {
+        m_panic = false;
+        return;
+      }
+      depth -= depth != 0;
+      break;
+    default:
+      if (depth == 0 && isTokenPunctuator("\n")) {
+        m_tokens.advance();
+        m_panic = false;
+        return;
+      }
+      break;
     }
+    m_tokens.advance();
+  }
+  m_panic = false;
+}
+
+bool Parser::skipKeyword(Keyword keyword) {
+  if (m_panic) {
+    return false;
+  }
+  if (!isTokenKeyword(keyword)) {
+    error(DiagnosticCode::EXPECTED_KEYWORD, m_tokens.index(), static_cast<uint32_t>(keyword));
+    return false;
+  }
+  m_tokens.advance();
+  return true;
+}
+
+bool Parser::skipOperator(Operator op) {
+  if (m_panic) {
+    return false;
+  }
+  if (!isTokenOperator(op)) {
+    error(DiagnosticCode::EXPECTED_OPERATOR, m_tokens.index(), static_cast<uint32_t>(op));
+    return false;
+  }
+  m_tokens.advance();
+  return true;
+}
+
+bool Parser::skipPunctuator(const std::string &value) {
+  if (m_panic) {
+    return false;
+  }
+  TRACE(PUNCTUATOR, m_tokens.buffer().offset(m_tokens.index()), NO_NODE, value[0]);
+  if (!isTokenPunctuator(value)) {
+    error(DiagnosticCode::EXPECTED_PUNCTUATOR, m_tokens.index(), static_cast<unsigned char>(value[0]));
+    return false;
+  }
+  m_tokens.advance();
+  return true;
+}
+
+Symbol Parser::symbolOf(size_t tok) {
+  const auto &tokens = m_tokens.buffer();
+  if (tokens.type(tok) == TokenType::IDENTIFIER) {
+    return Symbol{ tokens.id(tok) };
   }
-  return std::string(1, c);
+  return m_lexer.symbols().intern(tokens.value(tok));
+}
+
+NodeId Parser::addNode(ASTType type, size_t tok) {
+  ASTNode node;
+  node.type = type;
+  node.offset = m_tokens.buffer().start(tok);
+  NodeId id = m_ast.add(node);
+  TRACE(NODE, m_tokens.buffer().offset(tok), id);
+  return id;
+}
+
+NodeList Parser::popList(size_t mark) {
+  auto list = m_ast.addList(std::span<const NodeId>(m_scratch).subspan(mark));
+  m_scratch.resize(mark);
+  return list;
 }
 
-Token Parser::isTokenKeyword(const std::string &value) {
-  auto tok = m_lexer.currentToken();
-  if (tok == TokenType::KEYWORD && (value.size() == 0 || tok.value == value)) {
-    return tok;
+NodeId Parser::parseToplevel() {
+  ALLOC_SITE(LIST);
+  NodeId prog = addNode(ASTType::PROG, m_tokens.index());
+  size_t mark = m_scratch.size();
+  while (m_tokens.type() != TokenType::EOB) {
+    NodeId statement = parseStatement();
+    if (m_panic) {
+      synchronize(false);
+    } else {
+      m_scratch.push_back(statement);
+    }
+    m_tokens.release();
   }
-  return Token{TokenType::NONE, "", tok.row, tok.col};
+  m_ast.node(prog).prog.body = popList(mark);
+  return prog;
+}
+
+NodeId Parser::parseStatement() {
+  ALLOC_SITE(STATEMENT);
+  TRACE(STATEMENT, m_tokens.buffer().offset(m_tokens.index()), NO_NODE);
+  NodeId expr = parse(Frame(Step::EXPRESSION));
+  skipPunctuator("\n");
+  return expr;
 }
 
-Token Parser::isTokenOperator(const std::string &value) {
-  auto tok = m_lexer.currentToken();
-  if (tok == TokenType::OPERATOR && (value.size() == 0 || tok.value == value)) {
-    return tok;
+NodeId Parser::parse(Frame start) {
+  size_t base = m_frames.size();
+  m_frames.push_back(start);
+  while (m_frames.size() > base) {
+    Frame &frame = m_frames.back();
+    switch (frame.step) {
+    case Step::EXPRESSION:
+      parseExpression(frame);
+      break;
+    case Step::CLOSE:
+      m_depth--;
+      finish(m_result);
+      break;
+    case Step::ATOM:
+    case Step::ATOM_GROUP:
+    case Step::ATOM_CALL:
+      parseAtom(frame);
+      break;
+    case Step::UNARY:
+    case Step::UNARY_BINARY:
+    case Step::UNARY_DONE:
+      parseUnary(frame);
+      break;
+    case Step::BINARY:
+    case Step::BINARY_LEFT:
+    case Step::BINARY_RIGHT:
+      maybeBinary(frame);
+      break;
+    case Step::PROG:
+    case Step::PROG_ITEM:
+      parseProg(frame);
+      break;
+    case Step::IF:
+    case Step::IF_THEN:
+    case Step::IF_ELSE:
+    case Step::IF_DONE:
+      parseIf(frame);
+      break;
+    case Step::CALL:
+    case Step::CALL_DONE:
+      parseCall(frame);
+      break;
+    case Step::LIST:
+    case Step::LIST_ITEM:
+      delimited(frame);
+      break;
+    case Step::FUNCTION:
+    case Step::FUNCTION_TYPE:
+    case Step::FUNCTION_BODY:
+      parseFunction(frame);
+      break;
+    case Step::VAR:
+    case Step::VAR_DONE:
+      parseVar(frame);
+      break;
+    }
   }
-  return Token{TokenType::NONE, "", tok.row, tok.col};
+  return m_result;
+}
+
+void Parser::push(Frame &frame, Step resume, Frame child) {
+  frame.step = resume;
+  m_frames.push_back(child);
 }
 
-Token Parser::isTokenPunctuator(const std::string &value) {
-  auto tok = m_lexer.currentToken();
-  if (tok == TokenType::PUNCTUATOR && (value.size() == 0 || tok.value == value)) {
-    return tok;
+void Parser::nest(Frame &frame, Step resume, Frame child, bool skip) {
+  if (m_depth == m_maxDepth) {
+    return finish(fail(DiagnosticCode::NESTED_TOO_DEEPLY, m_maxDepth));
+  }
+  m_depth++;
+  if (skip) {
+    m_tokens.advance();
   }
-  return Token{TokenType::NONE, "", tok.row, tok.col};
+  push(frame, resume, child);
 }
 
-void Parser::skipKeyword(const std::string &value) {
-  if (!!isTokenKeyword(value)) {
-    m_lexer.nextToken();
+void Parser::open(Frame &frame, Frame child, bool skip) {
+  if (m_depth == m_maxDepth) {
+    return finish(fail(DiagnosticCode::NESTED_TOO_DEEPLY, m_maxDepth));
   }
-  else {
-    throw std::runtime_error("Expected keyword '" + value + "' at " + std::to_string(m_lexer.currentToken().row) + ":" + std::to_string(m_lexer.currentToken().col));
+  m_depth++;
+  if (skip) {
+    m_tokens.advance();
   }
+  frame = child;
+  frame.atom = true;
 }
 
-void Parser::skipOperator(const std::string &value) {
-  if (!!isTokenOperator(value)) {
-    m_lexer.nextToken();
+void Parser::finish(NodeId node) {
+  Frame &frame = m_frames.back();
+  if (frame.atom) {
+    m_depth--;
+    if (!m_panic && isTokenPunctuator("(")) {
+      frame = Frame(Step::ATOM_CALL, node);
+      return;
+    }
+  }
+  m_result = node;
+  m_frames.pop_back();
+}
+
+bool Parser::atom(Frame &frame, Step resume) {
+  NodeId leaf = m_panic ? NO_NODE : parseLeaf();
+  if (leaf == NO_NODE) {
+    push(frame, resume, Frame(Step::ATOM));
+    return false;
   }
-  else {
-    throw std::runtime_error("Expected operator '" + value + "' at " + std::to_string(m_lexer.currentToken().row) + ":" + std::to_string(m_lexer.currentToken().col));
+  if (!m_panic && isTokenPunctuator("(")) {
+    push(frame, resume, Frame(Step::ATOM_CALL, leaf));
+    return false;
   }
+  frame.step = resume;
+  m_result = leaf;
+  return true;
 }
 
-void Parser::skipPunctuator(const std::string &value) {
-  cout << "skipPunctuator(" << escapeChar(value[0]) << "); currentToken: " << m_lexer.currentToken() << endl;
-  if (!!isTokenPunctuator(value)) {
-    m_lexer.nextToken();
+bool Parser::expression(Frame &frame, Step resume) {
+  NodeId leaf = m_panic ? NO_NODE : parseLeaf();
+  if (leaf == NO_NODE) {
+    push(frame, resume, Frame(Step::EXPRESSION));
+    return false;
   }
-  else {
-    throw std::runtime_error("Expected punctuator '" + escapeChar(value[0]) + "' at " + std::to_string(m_lexer.currentToken().row) + ":" + std::to_string(m_lexer.currentToken().col));
+  bool called = !m_panic && isTokenPunctuator("(");
+  if (m_panic || (!called && operatorInfo(m_tokens.op()).binary == 0)) {
+    frame.step = resume;
+    m_result = leaf;
+    return true;
   }
+
+  // As parseExpression() would go on after parsing `leaf`.
+  Frame binary(Step::BINARY, leaf, 0);
+  binary.call = true;
+  push(frame, resume, binary);
+  if (called) {
+    push(m_frames.back(), Step::BINARY_LEFT, Frame(Step::ATOM_CALL, leaf));
+  }
+  return false;
 }
 
-AST Parser::parseToplevel() {
-  AST ast;
-  ast.type = ASTType::PROG;
-  ast[astid::PROG] = std::vector<AST>{};
-  while (m_lexer.currentToken() != TokenType::EOB) {
-    cout << "Parsing: " << m_lexer.currentToken() << endl;
-    std::get<std::vector<AST>>
-      (ast[astid::PROG]).push_back(parseExpression());
-    skipPunctuator("\n");
+void Parser::parseExpression(Frame &frame) {
+  frame.step = Step::BINARY_LEFT;
+  frame.call = true;
+  if (atom(frame, Step::BINARY_LEFT)) {
+    maybeBinary(frame);
   }
-  return ast;
 }
 
-AST Parser::parseAtom() {
-  return maybeCall([this]() -> AST {
+void Parser::parseAtom(Frame &frame) {
+  ALLOC_SITE(ATOM);
+  switch (frame.step) {
+  case Step::ATOM_GROUP:
+    m_depth--;
+    skipPunctuator(")");
+    return maybeCall(frame, m_result);
+  case Step::ATOM_CALL:
+    return maybeCall(frame, frame.left);
+  default:
+    break;
+  }
+
+  if (m_panic) {
+    return finish(addNode(ASTType::NONE, m_tokens.index()));
+  }
+
 Parser_parseAtomStart:
-    if (!!this->isTokenPunctuator("\n")) {
-      this->m_lexer.nextToken();
-      goto Parser_parseAtomStart;
-    }
+  if (isTokenPunctuator("\n")) {
+    m_tokens.advance();
+    goto Parser_parseAtomStart;
+  }
 
-    if (!!this->isTokenPunctuator("(")) {
-      cout << "Parsing: " << m_lexer.currentToken() << endl;
-      this->m_lexer.nextToken();
-      cout << "Parsing: " << m_lexer.currentToken() << endl;
-      auto exp = this->parseExpression();
-      cout << "Parsing: " << m_lexer.currentToken() << endl;
-      this->skipPunctuator(")");
-      return exp;
-    }
+  if (isTokenPunctuator("(")) {
+    TRACE(GROUP, m_tokens.buffer().offset(m_tokens.index()), NO_NODE);
+    return nest(frame, Step::ATOM_GROUP, Frame(Step::EXPRESSION), true);
+  }
 
-    if ( false
-      || !!this->isTokenKeyword("begin")
-      || !!this->isTokenKeyword("do")
-      || !!this->isTokenKeyword("then")
-    ) {
-      this->m_lexer.nextToken();
-      return this->parseProg();
-    }
+  if (operatorInfo(m_tokens.op()).prefix != 0) {
+    return open(frame, Frame(Step::UNARY));
+  }
 
-    if (!!this->isTokenKeyword("if")) {
-      return this->parseIf();
-    }
+  switch (m_tokens.keyword()) {
+  case Keyword::BEGIN:
+  case Keyword::DO:
+  case Keyword::THEN:
+    return open(frame, Frame(Step::PROG), true);
 
-    if (!!this->isTokenKeyword("true") || !!this->isTokenKeyword("false")) {
-      return this->parseBool();
-    }
+  case Keyword::IF:
+    return open(frame, Frame(Step::IF));
 
-    if (!!this->isTokenKeyword("define")) {
-      return this->parseFunction();
-    }
+  case Keyword::DEFINE:
+    return open(frame, Frame(Step::FUNCTION));
 
-    if (!!this->isTokenKeyword("let")) {
-      this->m_lexer.nextToken();
-      return this->parseVar();
-    }
+  case Keyword::LET:
+    return open(frame, Frame(Step::VAR), true);
 
-    auto tok = this->m_lexer.nextToken();
-    AST ast;
+  default:
+    break;
+  }
 
-    if (tok == TokenType::IDENTIFIER) {
-      ast.type = ASTType::NAME;
-      ast[astid::VALUE] = tok.value;
-      return ast;
-    }
+  NodeId leaf = parseLeaf();
+  maybeCall(frame, leaf != NO_NODE ? leaf : fail(DiagnosticCode::UNEXPECTED_TOKEN));
+}
 
-    if (tok == TokenType::INTEGER) {
-      ast.type = ASTType::INTEGER;
-      ast[astid::VALUE] = std::stol(tok.value);
-      return ast;
+NodeId Parser::parseLeaf() {
+  // As at the start of parseAtom().
+  while (isTokenPunctuator("\n")) {
+    m_tokens.advance();
+  }
+
+  auto tok = m_tokens.index();
+  const auto &tokens = m_tokens.buffer();
+
+  switch (tokens.type(tok)) {
+  case TokenType::KEYWORD:
+    if (isTokenKeyword(Keyword::TRUE) || isTokenKeyword(Keyword::FALSE)) {
+      return parseBool();
     }
+    return NO_NODE;
+
+  case TokenType::IDENTIFIER: {
+    m_tokens.advance();
+    NodeId id = addNode(ASTType::NAME, tok);
+    m_ast.node(id).name = Symbol{ tokens.id(tok) };
+    return id;
+  }
 
-    if (tok == TokenType::FLOAT) {
-      ast.type = ASTType::FLOAT;
-      ast[astid::VALUE] = std::stod(tok.value);
-      return ast;
+  case TokenType::INTEGER:
+  case TokenType::FLOAT: {
+    bool real = tokens.type(tok) == TokenType::FLOAT;
+    if (tokens.id(tok) == number::MALFORMED || tokens.id(tok) == number::OUT_OF_RANGE) {
+      auto code = tokens.id(tok) == number::MALFORMED ? DiagnosticCode::MALFORMED_NUMBER : DiagnosticCode::NUMBER_OUT_OF_RANGE;
+      return fail(code, static_cast<uint32_t>(tokens.type(tok)));
+    }
+    m_tokens.advance();
+    NodeId id = addNode(real ? ASTType::FLOAT : ASTType::INTEGER, tok);
+    if (real) {
+      m_ast.node(id).real = tokens.number(tok).real;
+    } else {
+      m_ast.node(id).integer = tokens.number(tok).integer;
     }
+    return id;
+  }
 
-    if (tok == TokenType::STRING) {
-      ast.type = ASTType::STRING;
-      ast[astid::VALUE] = tok.value;
-      return ast;
+  case TokenType::STRING: {
+    if (tokens.id(tok) == literal::UNTERMINATED) {
+      return fail(DiagnosticCode::UNTERMINATED_LITERAL, static_cast<uint32_t>(TokenType::STRING));
     }
+    m_tokens.advance();
+    NodeId id = addNode(ASTType::STRING, tok);
+    m_ast.node(id).string = m_ast.addString(tokens.value(tok));
+    return id;
+  }
 
-    if (tok == TokenType::CHAR) {
-      ast.type = ASTType::CHAR;
-      ast[astid::VALUE] = tok.value[0];
-      return ast;
+  case TokenType::CHAR: {
+    if (tokens.id(tok) == literal::UNTERMINATED) {
+      return fail(DiagnosticCode::UNTERMINATED_LITERAL, static_cast<uint32_t>(TokenType::CHAR));
     }
+    std::string_view value = tokens.value(tok);
+    if (value.size() != 1) {
+      return fail(DiagnosticCode::MALFORMED_CHAR);
+    }
+    m_tokens.advance();
+    NodeId id = addNode(ASTType::CHAR, tok);
+    m_ast.node(id).character = value[0];
+    return id;
+  }
 
-    throw std::runtime_error("Unexpected token '" + tok.value + "' at " + std::to_string(tok.row) + ":" + std::to_string(tok.col));
-  });
+  default:
+    return NO_NODE;
+  }
 }
 
-AST Parser::parseExpression() {
-  return maybeCall([this]() {
-    return this->maybeBinary(this->parseAtom(), 0);
-  });
+void Parser::maybeCall(Frame &frame, NodeId atom) {
+  if (!m_panic && isTokenPunctuator("(")) {
+    return nest(frame, Step::CLOSE, Frame(Step::CALL, atom));
+  }
+  finish(atom);
 }
 
-AST Parser::parseCall(AST function) {
-  AST ast;
-  ast.type = ASTType::CALL;
-  ast[astid::CALL_FUNC] = std::make_shared<AST>(std::move(function));
-  ast[astid::CALL_ARGS] = delimited<AST>("(", ")", ",", [this]() {
-    return this->parseExpression();
-  });
+void Parser::parseCall(Frame &frame) {
+  ALLOC_SITE(CALL);
+  if (frame.step == Step::CALL) {
+    NodeId call = m_ast.add(m_ast.node(frame.left));
+    TRACE(NODE, m_tokens.buffer().offset(m_tokens.index()), call);
+    ASTNode &node = m_ast.node(call);
+    node.type = ASTType::CALL;
+    node.call.func = frame.left;
+    frame.node = call;
+    return push(frame, Step::CALL_DONE, Frame(Step::LIST));
+  }
 
-  return ast;
+  m_ast.node(frame.node).call.args = m_list;
+  finish(frame.node);
 }
 
-AST Parser::parseProg() {
-  std::vector<AST> prog;
-  while (!isTokenKeyword("end")) {
-    if (m_lexer.eof()) {
-      throw std::runtime_error("Expected 'end' at " + std::to_string(m_lexer.currentToken().row) + ":" + std::to_string(m_lexer.currentToken().col));
+void Parser::delimited(Frame &frame) {
+  ALLOC_SITE(LIST);
+  if (frame.step == Step::LIST) {
+    frame.mark = static_cast<uint32_t>(m_scratch.size());
+    skipPunctuator("(");
+  }
+  while (true) {
+    if (frame.step == Step::LIST_ITEM && !m_panic) {
+      m_scratch.push_back(m_result);
+    }
+
+    if (m_panic || m_tokens.type() == TokenType::EOB || isTokenPunctuator(")")) {
+      break;
+    }
+    if (frame.first) {
+      frame.first = false;
+    } else {
+      skipPunctuator(",");
+    }
+    if (isTokenPunctuator(")")) {
+      break;
+    }
+    if (frame.item != Step::EXPRESSION) {
+      return push(frame, Step::LIST_ITEM, Frame(frame.item));
+    }
+    if (!expression(frame, Step::LIST_ITEM)) {
+      return;
     }
-    prog.push_back(parseExpression());
-    
-    skipPunctuator("\n");
   }
-  m_lexer.nextToken();
-  AST ast;
-  ast.type = ASTType::PROG;
-  ast[astid::PROG] = std::move(prog);
+  skipPunctuator(")");
 
-  return ast;
+  m_list = popList(frame.mark);
+  m_frames.pop_back();
 }
 
-AST Parser::parseIf() {
-  m_lexer.nextToken();
-  auto cond = parseExpression();
-  auto then = parseExpression();
+void Parser::parseProg(Frame &frame) {
+  ALLOC_SITE(LIST);
+  if (frame.step == Step::PROG) {
+    frame.node = addNode(ASTType::PROG, m_tokens.index());
+    frame.mark = static_cast<uint32_t>(m_scratch.size());
+  }
+  while (true) {
+    if (frame.step == Step::PROG_ITEM) {
+      if (!m_panic) {
+        m_scratch.push_back(m_result);
+        skipPunctuator("\n");
+      }
+      if (m_panic) {
+        synchronize(true);
+      }
+    }
 
-  AST::ValueType else_ = nullptr;
-  if (!!isTokenKeyword("else")) {
-    m_lexer.nextToken();
-    else_ = std::make_shared<AST>(parseExpression());
+    if (isTokenKeyword(Keyword::END)) {
+      m_tokens.advance();
+      m_ast.node(frame.node).prog.body = popList(frame.mark);
+      return finish(frame.node);
+    }
+    if (m_tokens.type() == TokenType::EOB) {
+      // Left in panic, so that the statement holding the block is dropped.
+      error(DiagnosticCode::EXPECTED_END, m_tokens.index());
+      m_scratch.resize(frame.mark);
+      return finish(frame.node);
+    }
+    if (!expression(frame, Step::PROG_ITEM)) {
+      return;
+    }
   }
+}
 
-  AST ast;
-  ast.type = ASTType::IF;
-  ast[astid::IF_COND] = std::make_shared<AST>(std::move(cond));
-  ast[astid::IF_THEN] = std::make_shared<AST>(std::move(then));
-  ast[astid::IF_ELSE] = std::move(else_);
+void Parser::parseIf(Frame &frame) {
+  switch (frame.step) {
+  case Step::IF:
+    frame.node = addNode(ASTType::IF, nextToken());
+    if (!expression(frame, Step::IF_THEN)) {
+      return;
+    }
+    [[fallthrough]];
+  case Step::IF_THEN:
+    frame.left = m_result;
+    if (!expression(frame, Step::IF_ELSE)) {
+      return;
+    }
+    [[fallthrough]];
+  case Step::IF_ELSE:
+    frame.right = m_result;
+    if (!m_panic && isTokenKeyword(Keyword::ELSE)) {
+      m_tokens.advance();
+      if (!expression(frame, Step::IF_DONE)) {
+        return;
+      }
+    }
+    break;
+  default:
+    break;
+  }
 
-  return ast;
+  auto &node = m_ast.node(frame.node).if_;
+  node.cond = frame.left;
+  node.then = frame.right;
+  node.else_ = frame.step == Step::IF_DONE ? m_result : NO_NODE;
+  finish(frame.node);
 }
 
-AST Parser::parseBool() {
-  AST ast;
-  ast.type = ASTType::BOOL;
-  ast[astid::VALUE] = !!isTokenKeyword("true");
-  m_lexer.nextToken();
+NodeId Parser::parseBool() {
+  NodeId ast = addNode(ASTType::BOOL, m_tokens.index());
+  m_ast.node(ast).boolean = isTokenKeyword(Keyword::TRUE);
+  m_tokens.advance();
   return ast;
 }
 
-AST Parser::parseFunction() {
-  AST ast;
-
-  m_lexer.nextToken();
+void Parser::parseFunction(Frame &frame) {
+  ALLOC_SITE(FUNCTION);
+  switch (frame.step) {
+  case Step::FUNCTION: {
+    frame.node = addNode(ASTType::FUNCTION, nextToken());
 
-  auto name = m_lexer.nextToken();
-  cout << "  Name: " << name << endl;
+    TRACE(FUNCTION, m_tokens.buffer().offset(m_tokens.index()), frame.node);
+    auto name = m_tokens.symbol();
+    if (!name) {
+      return finish(fail(DiagnosticCode::EXPECTED_IDENTIFIER));
+    }
+    m_tokens.advance();
 
-  if (name != TokenType::IDENTIFIER) {
-    throw std::runtime_error("Expected identifier at " + std::to_string(m_lexer.currentToken().row) + ":" + std::to_string(m_lexer.currentToken().col));
+    m_ast.node(frame.node).function.name = name;
+    Frame params(Step::LIST);
+    params.item = Step::VAR;
+    return push(frame, Step::FUNCTION_TYPE, params);
+  }
+  case Step::FUNCTION_TYPE:
+    m_ast.node(frame.node).function.params = m_list;
+    skipKeyword(Keyword::AS);
+    frame.type = static_cast<uint32_t>(parseType());
+    if (!expression(frame, Step::FUNCTION_BODY)) {
+      return;
+    }
+    break;
+  default:
+    break;
   }
 
-  ast.type = ASTType::FUNCTION;
-  ast[astid::FUNCTION_NAME] = name.value;
-  ast[astid::FUNCTION_PARAMS] = delimited<AST>("(", ")", ",", [this]() { return this->parseVar(); });
-
-  skipKeyword("as");
-  auto type = m_lexer.nextToken(); // TODO: parse types
-
-  ast[astid::FUNCTION_BODY] = std::make_shared<AST>(parseExpression());
-  ast[astid::FUNCTION_RETTYPE] = type.value;
+  NodeId body = m_result;
+  if (m_panic) {
+    return finish(frame.node);
+  }
+  m_ast.node(frame.node).function.body = body;
+  m_ast.node(frame.node).function.retType = symbolOf(frame.type);
 
-  if (std::get<AST::Ptr>(ast[astid::FUNCTION_BODY])->type != ASTType::PROG) {
-    throw std::runtime_error("Expected function body to be a program at " + std::to_string(m_lexer.currentToken().row) + ":" + std::to_string(m_lexer.currentToken().col));
+  if (m_ast.node(body).type != ASTType::PROG) {
+    error(DiagnosticCode::EXPECTED_FUNCTION_BODY, m_tokens.index());
   }
 
-  return ast;
+  finish(frame.node);
 }
 
-AST Parser::parseVar() {
-  auto name = m_lexer.nextToken();
-  if (name != TokenType::IDENTIFIER) {
-    throw std::runtime_error("Expected identifier at " + std::to_string(m_lexer.currentToken().row) + ":" + std::to_string(m_lexer.currentToken().col));
-  }
-
-  skipKeyword("as");
+void Parser::parseVar(Frame &frame) {
+  if (frame.step == Step::VAR) {
+    if (m_panic || m_tokens.type() != TokenType::IDENTIFIER) {
+      return finish(fail(DiagnosticCode::EXPECTED_IDENTIFIER));
+    }
+    frame.name = static_cast<uint32_t>(nextToken());
 
-  auto type = m_lexer.nextToken(); // TODO: parse type
+    skipKeyword(Keyword::AS);
 
-  AST::ValueType value = nullptr;
+    frame.type = static_cast<uint32_t>(parseType());
 
-  if (!!isTokenOperator("=")) {
-    m_lexer.nextToken();
-    value = std::make_shared<AST>(parseExpression());
+    if (!m_panic && isTokenOperator(Operator::ASSIGN)) {
+      m_tokens.advance();
+      if (!expression(frame, Step::VAR_DONE)) {
+        return;
+      }
+    }
   }
 
-  AST ast;
-  ast.type = ASTType::VAR;
-  ast[astid::VAR_NAME] = std::move(name.value);
-  ast[astid::VAR_TYPE] = std::move(type.value);
-  ast[astid::VAR_INITVAL] = std::move(value);
+  NodeId ast = addNode(ASTType::VAR, frame.name);
+  auto &node = m_ast.node(ast).var;
+  node.name = symbolOf(frame.name);
+  node.type = symbolOf(frame.type);
+  node.init = frame.step == Step::VAR_DONE ? m_result : NO_NODE;
 
-  return ast;
+  finish(ast);
 }
 
-AST Parser::maybeCall(AST::Function expr) {
-  auto e = expr();
-  return !!isTokenPunctuator("(") ? parseCall(e) : e;
+size_t Parser::parseType() {
+  // TODO: parse types
+  if (!m_panic && m_tokens.type() != TokenType::IDENTIFIER) {
+    error(DiagnosticCode::EXPECTED_TYPE, m_tokens.index());
+  }
+  return m_panic ? m_tokens.index() : nextToken();
 }
 
-AST Parser::maybeBinary(AST left, uint32_t myPrec) {
-  auto tok = isTokenOperator("");
-  if (!tok) {
-    return left;
+void Parser::maybeBinary(Frame &frame) {
+  ALLOC_SITE(BINARY);
+  // Operands parsed in place let a chain of operators run on in this loop.
+  bool right = frame.step == Step::BINARY_RIGHT;
+  if (frame.step == Step::BINARY_LEFT) {
+    frame.left = m_result;
   }
+  while (true) {
+    if (right) {
+      frame.right = m_result;
+      const auto &info = operatorInfo(frame.op);
+
+      // Let tighter operators, or this one again if it groups to the right,
+      // claim the right operand first.
+      if (!m_panic) {
+        const auto &next = operatorInfo(m_tokens.op());
+        if (next.binary > info.binary) {
+          return push(frame, Step::BINARY_RIGHT, Frame(Step::BINARY, frame.right, info.binary + 1));
+        } else if (next.binary == info.binary && info.rightAssoc) {
+          return push(frame, Step::BINARY_RIGHT, Frame(Step::BINARY, frame.right, info.binary));
+        }
+      }
+
+      NodeId binary = m_ast.add(m_ast.node(frame.left));
+      auto &node = m_ast.node(binary);
+      node.type = frame.op == Operator::ASSIGN ? ASTType::ASSIGN : ASTType::BINARY;
+      node.binary.op = frame.op;
+      node.binary.left = frame.left;
+      node.binary.right = frame.right;
+      frame.left = binary;
+    }
 
-  auto hisPrec = OPERATOR_PRECEDENCE.at(tok.value);
-  if (hisPrec < myPrec) {
-    return left;
+    Operator op = m_tokens.op();
+    const auto &info = operatorInfo(op);
+    if (m_panic || info.binary == 0 || info.binary < frame.minPrec) {
+      return frame.call ? maybeCall(frame, frame.left) : finish(frame.left);
+    }
+    TRACE(OPERATOR, m_tokens.buffer().offset(m_tokens.index()), NO_NODE);
+    m_tokens.advance();
+
+    frame.op = op;
+    if (!atom(frame, Step::BINARY_RIGHT)) {
+      return;
+    }
+    right = true;
   }
+}
 
-  m_lexer.nextToken();
-  auto right = maybeBinary(parseAtom(), hisPrec);
-  AST binary;
-  binary.type = tok.value == "=" ? ASTType::ASSIGN : ASTType::BINARY;
-  binary[astid::BINARY_OP] = std::move(tok.value);
-  binary[astid::BINARY_LEFT] = std::make_shared<AST>(std::move(left));
-  binary[astid::BINARY_RIGHT] = std::make_shared<AST>(std::move(right));
+void Parser::parseUnary(Frame &frame) {
+  switch (frame.step) {
+  case Step::UNARY:
+    frame.node = addNode(ASTType::UNARY, m_tokens.index());
+    frame.op = m_tokens.op();
+    m_tokens.advance();
+    if (!atom(frame, Step::UNARY_BINARY)) {
+      return;
+    }
+    [[fallthrough]];
+  case Step::UNARY_BINARY:
+    // Binary operators binding tighter than the prefix still go to its
+    // operand.
+    return push(frame, Step::UNARY_DONE, Frame(Step::BINARY, m_result, operatorInfo(frame.op).prefix + 1));
+  default:
+    break;
+  }
 
-  return maybeBinary(std::move(binary), myPrec);
-}
\ No newline at end of file
+  auto &node = m_ast.node(frame.node).unary;
+  node.op = frame.op;
+  node.operand = m_result;
+  finish(frame.node);
+}
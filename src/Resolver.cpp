@@ -0,0 +1,531 @@
+#include "Resolver.h"
+
+#include <algorithm>
+#include <exception>
+#include <memory>
+#include <stdexcept>
+
+#include "SourceMap.h"
+#include "ThreadPool.h"
+
+// Below this many nodes a program resolves faster than a pool starts up.
+static constexpr size_t PARALLEL_NODES = 1 << 15;
+
+static bool isIntegral(ValueKind kind) {
+  return kind == ValueKind::INT || kind == ValueKind::BOOL || kind == ValueKind::CHAR;
+}
+
+static bool isNumeric(ValueKind kind) {
+  return isIntegral(kind) || kind == ValueKind::FLOAT;
+}
+
+// The state of resolving one function: the locals in scope, innermost last,
+// and for each symbol the one its name currently means. Declaring a local
+// remembers what it shadows and closing its block restores that, so a
+// lookup is one index and leaving a scope costs one step per local.
+class Resolver::Walk {
+private:
+  struct Local {
+    Symbol name;
+    uint32_t slot;
+    uint16_t depth;
+    ValueKind kind;
+    uint32_t shadowed; // index into m_locals, or NONE
+  };
+
+  const Resolver &m_resolver;
+  const AST &m_ast;
+  Semantics &m_out;
+
+  std::vector<uint32_t> m_innermost; // by symbol id: index into m_locals
+  std::vector<Local> m_locals;
+  // Operators of the chains being resolved, innermost last. The parser puts
+  // no bound on how long a chain is, and so on how deep it nests, so chains
+  // are walked in a loop over this rather than by recursion.
+  std::vector<NodeId> m_chain;
+  uint16_t m_depth = 0;
+  uint32_t m_slots = 0; // locals of the function so far
+
+public:
+  explicit Walk(Resolver &resolver)
+    : m_resolver(resolver), m_ast(resolver.m_ast), m_out(resolver.m_out),
+      m_innermost(resolver.m_symbols.size(), NONE) { }
+
+  void function(Semantics::Function &function);
+  void main(Semantics::Function &main);
+
+private:
+  ValueKind expr(NodeId id);
+  ValueKind prog(NodeList body);
+  ValueKind var(NodeId id, bool global);
+  // A BINARY and those down its left spine, `a + b + c`.
+  ValueKind chain(NodeId id);
+  ValueKind binary(NodeId id, ValueKind lk, ValueKind rk);
+  // An ASSIGN and those down its right spine, `a = b = c`.
+  ValueKind assign(NodeId id);
+  ValueKind store(NodeId id, ValueKind kind);
+  ValueKind unary(NodeId id);
+  ValueKind branch(NodeId id);
+  ValueKind call(NodeId id);
+
+  void declare(NodeId id, ValueKind kind);
+  // Forgets every local declared after the first `mark`.
+  void close(size_t mark);
+  const Local *find(Symbol name) const;
+  void bind(NodeId id, ValueKind kind, uint16_t depth, uint32_t slot);
+  void convert(ValueKind from, ValueKind to, const ASTNode &at) const;
+
+  [[noreturn]] inline void error(const std::string &message, const ASTNode &at) const {
+    m_resolver.error(message, at);
+  }
+  inline std::string name(Symbol symbol) const {
+    return std::string(m_resolver.m_symbols.name(symbol));
+  }
+};
+
+Resolver::Resolver(const AST &ast, const SymbolTable &symbols) : m_ast(ast), m_symbols(symbols) { }
+
+Semantics Resolver::operator()(unsigned jobs) {
+  NodeId root = m_ast.root();
+  if (root == NO_NODE || m_ast.node(root).type != ASTType::PROG) {
+    throw std::runtime_error("Expected a program to compile");
+  }
+
+  m_out.m_kinds.assign(m_ast.size(), ValueKind::INT);
+  m_out.m_depths.assign(m_ast.size(), 0);
+  m_out.m_slots.assign(m_ast.size(), NONE);
+
+  m_types.assign(m_symbols.size(), NO_KIND);
+  for (ValueKind kind : { ValueKind::INT, ValueKind::FLOAT, ValueKind::BOOL, ValueKind::CHAR, ValueKind::STRING }) {
+    Symbol type = m_symbols.find(valueKindName(kind));
+    if (type.id != Symbol::NONE) {
+      m_types[type.id] = static_cast<uint8_t>(kind);
+    }
+  }
+  m_globalOf.assign(m_symbols.size(), NONE);
+  m_functionOf.assign(m_symbols.size(), NONE);
+  m_print = m_symbols.find("print");
+
+  declare(root);
+  Semantics::Function main;
+  main.node = root;
+  m_out.m_functions.push_back(std::move(main));
+
+  auto &functions = m_out.m_functions;
+  if (jobs == 1 || functions.size() < 3 || m_ast.size() < PARALLEL_NODES) {
+    Walk walk(*this);
+    for (size_t i = 0; i + 1 < functions.size(); i++) {
+      walk.function(functions[i]);
+    }
+    walk.main(functions.back());
+    return std::move(m_out);
+  }
+
+  // Each body writes only the table entries of its own nodes. The bodies
+  // go out in a few runs of consecutive functions per worker, each resolved
+  // by one Walk that stops at its first error.
+  std::vector<std::exception_ptr> errors(functions.size());
+  {
+    ThreadPool pool(jobs);
+    std::vector<std::unique_ptr<Walk>> walks(pool.size());
+    size_t count = std::min<size_t>(pool.size() * 4, functions.size());
+    for (size_t run = 0; run < count; run++) {
+      size_t begin = functions.size() * run / count;
+      size_t end = functions.size() * (run + 1) / count;
+      pool.submit([this, &functions, &walks, &errors, begin, end](unsigned worker) {
+        if (!walks[worker]) {
+          walks[worker] = std::make_unique<Walk>(*this);
+        }
+        for (size_t i = begin; i < end; i++) {
+          try {
+            if (i + 1 < functions.size()) {
+              walks[worker]->function(functions[i]);
+            } else {
+              walks[worker]->main(functions[i]);
+            }
+          } catch (...) {
+            errors[i] = std::current_exception();
+            return;
+          }
+        }
+      });
+    }
+    pool.wait();
+  }
+  for (const auto &error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+  return std::move(m_out);
+}
+
+void Resolver::declare(NodeId root) {
+  // Every function and global is known before any body is resolved, so
+  // functions can call each other and use globals in any order.
+  for (NodeId id : m_ast.list(m_ast.node(root).prog.body)) {
+    const ASTNode &node = m_ast.node(id);
+    if (node.type == ASTType::FUNCTION) {
+      auto &fn = node.function;
+      if (m_functionOf[fn.name.id] != NONE) {
+        error("Function '" + std::string(m_symbols.name(fn.name)) + "' is already defined", node);
+      }
+      Semantics::Function function;
+      function.node = id;
+      function.name = fn.name;
+      for (NodeId param : m_ast.list(fn.params)) {
+        const ASTNode &var = m_ast.node(param);
+        if (var.var.init != NO_NODE) {
+          error("Parameters cannot have default values", var);
+        }
+        function.params.push_back(typeOf(var.var.type, var));
+      }
+      function.result = typeOf(fn.retType, node);
+
+      auto index = static_cast<uint32_t>(m_out.m_functions.size());
+      m_functionOf[fn.name.id] = index;
+      m_out.m_kinds[id] = function.result;
+      m_out.m_slots[id] = index;
+      m_out.m_functions.push_back(std::move(function));
+    } else if (node.type == ASTType::VAR) {
+      ValueKind kind = typeOf(node.var.type, node);
+      uint32_t &global = m_globalOf[node.var.name.id];
+      if (global == NONE) {
+        global = static_cast<uint32_t>(m_out.m_globals.size());
+        m_out.m_globals.push_back(kind);
+      } else if (m_out.m_globals[global] != kind) {
+        error("Global '" + std::string(m_symbols.name(node.var.name)) + "' was declared as " + std::string(valueKindName(m_out.m_globals[global])), node);
+      }
+    }
+  }
+}
+
+ValueKind Resolver::typeOf(Symbol type, const ASTNode &at) const {
+  if (m_types[type.id] == NO_KIND) {
+    error("Unknown type '" + std::string(m_symbols.name(type)) + "'", at);
+  }
+  return static_cast<ValueKind>(m_types[type.id]);
+}
+
+void Resolver::error(const std::string &message, const ASTNode &at) const {
+  throw SourceError(message, at.offset);
+}
+
+void Resolver::Walk::function(Semantics::Function &function) {
+  const ASTNode &node = m_ast.node(function.node);
+  close(0);
+  m_slots = 0;
+  m_depth = 1;
+
+  auto params = m_ast.list(node.function.params);
+  for (size_t i = 0; i < params.size(); i++) {
+    declare(params[i], function.params[i]);
+  }
+  convert(expr(node.function.body), function.result, node);
+
+  close(0);
+  function.locals = m_slots;
+}
+
+void Resolver::Walk::main(Semantics::Function &main) {
+  const ASTNode &node = m_ast.node(main.node);
+  close(0);
+  m_slots = 0;
+  m_depth = 0;
+
+  // Top-level lets are the globals; their blocks' lets are main's locals.
+  ValueKind kind = ValueKind::INT;
+  for (NodeId id : m_ast.list(node.prog.body)) {
+    switch (m_ast.node(id).type) {
+    case ASTType::FUNCTION:
+      break;
+    case ASTType::VAR:
+      kind = var(id, true);
+      break;
+    default:
+      kind = expr(id);
+      break;
+    }
+  }
+
+  m_out.m_kinds[main.node] = kind;
+  main.result = kind;
+  main.locals = m_slots;
+}
+
+ValueKind Resolver::Walk::expr(NodeId id) {
+  const ASTNode &node = m_ast.node(id);
+
+  ValueKind kind = ValueKind::INT;
+  switch (node.type) {
+  case ASTType::NAME:
+    if (const Local *local = find(node.name)) {
+      kind = local->kind;
+      bind(id, kind, local->depth, local->slot);
+    } else if (uint32_t global = m_resolver.m_globalOf[node.name.id]; global != NONE) {
+      kind = m_out.m_globals[global];
+      bind(id, kind, 0, global);
+    } else if (m_resolver.m_functionOf[node.name.id] != NONE) {
+      error("Function '" + name(node.name) + "' cannot be used as a value", node);
+    } else {
+      error("Unknown name '" + name(node.name) + "'", node);
+    }
+    break;
+  case ASTType::INTEGER:
+    break;
+  case ASTType::FLOAT:
+    kind = ValueKind::FLOAT;
+    break;
+  case ASTType::BOOL:
+    kind = ValueKind::BOOL;
+    break;
+  case ASTType::CHAR:
+    kind = ValueKind::CHAR;
+    break;
+  case ASTType::STRING:
+    kind = ValueKind::STRING;
+    break;
+  case ASTType::PROG:
+    kind = prog(node.prog.body);
+    break;
+  case ASTType::BINARY:
+    kind = chain(id);
+    break;
+  case ASTType::ASSIGN:
+    kind = assign(id);
+    break;
+  case ASTType::UNARY:
+    kind = unary(id);
+    break;
+  case ASTType::IF:
+    kind = branch(id);
+    break;
+  case ASTType::CALL:
+    kind = call(id);
+    break;
+  case ASTType::VAR:
+    error("'let' must be a statement of its own", node);
+  case ASTType::FUNCTION:
+    error("'define' is only allowed at the top level", node);
+  default:
+    error("Cannot compile " + std::string(astTypeName(node.type)), node);
+  }
+
+  m_out.m_kinds[id] = kind;
+  return kind;
+}
+
+ValueKind Resolver::Walk::prog(NodeList body) {
+  size_t mark = m_locals.size();
+  m_depth++;
+
+  ValueKind kind = ValueKind::INT;
+  for (NodeId id : m_ast.list(body)) {
+    if (m_ast.node(id).type == ASTType::VAR) {
+      kind = var(id, false);
+    } else {
+      kind = expr(id);
+    }
+  }
+
+  m_depth--;
+  close(mark);
+  return kind;
+}
+
+ValueKind Resolver::Walk::var(NodeId id, bool global) {
+  const ASTNode &node = m_ast.node(id);
+  ValueKind kind = m_resolver.typeOf(node.var.type, node);
+
+  // The initializer still sees any outer variable of the same name.
+  if (node.var.init != NO_NODE) {
+    convert(expr(node.var.init), kind, node);
+  }
+  if (global) {
+    bind(id, kind, 0, m_resolver.m_globalOf[node.var.name.id]);
+  } else {
+    declare(id, kind);
+  }
+  return kind;
+}
+
+ValueKind Resolver::Walk::assign(NodeId id) {
+  size_t base = m_chain.size();
+  NodeId value = id;
+  while (m_ast.node(value).type == ASTType::ASSIGN) {
+    const ASTNode &target = m_ast.node(m_ast.node(value).binary.left);
+    if (target.type != ASTType::NAME) {
+      error("Only a name can be assigned to", target);
+    }
+    m_chain.push_back(value);
+    value = m_ast.node(value).binary.right;
+  }
+
+  ValueKind kind = expr(value);
+  while (m_chain.size() > base) {
+    NodeId at = m_chain.back();
+    m_chain.pop_back();
+    kind = store(at, kind);
+    m_out.m_kinds[at] = kind;
+  }
+  return kind;
+}
+
+ValueKind Resolver::Walk::store(NodeId id, ValueKind kind) {
+  const ASTNode &node = m_ast.node(id);
+  NodeId left = node.binary.left;
+  const ASTNode &target = m_ast.node(left);
+  if (const Local *local = find(target.name)) {
+    convert(kind, local->kind, node);
+    bind(left, local->kind, local->depth, local->slot);
+    return local->kind;
+  }
+  if (uint32_t global = m_resolver.m_globalOf[target.name.id]; global != NONE) {
+    convert(kind, m_out.m_globals[global], node);
+    bind(left, m_out.m_globals[global], 0, global);
+    return m_out.m_globals[global];
+  }
+  error("Unknown name '" + name(target.name) + "'", target);
+}
+
+ValueKind Resolver::Walk::chain(NodeId id) {
+  size_t base = m_chain.size();
+  NodeId left = id;
+  while (m_ast.node(left).type == ASTType::BINARY) {
+    m_chain.push_back(left);
+    left = m_ast.node(left).binary.left;
+  }
+
+  ValueKind kind = expr(left);
+  while (m_chain.size() > base) {
+    NodeId at = m_chain.back();
+    m_chain.pop_back();
+    kind = binary(at, kind, expr(m_ast.node(at).binary.right));
+    m_out.m_kinds[at] = kind;
+  }
+  return kind;
+}
+
+ValueKind Resolver::Walk::binary(NodeId id, ValueKind lk, ValueKind rk) {
+  const ASTNode &node = m_ast.node(id);
+  Operator op = node.binary.op;
+  if (op == Operator::AND || op == Operator::OR) {
+    // Either operand is tested for truth, whatever its kind.
+    return ValueKind::BOOL;
+  }
+
+  bool compare = op == Operator::EQ || op == Operator::NE || op == Operator::LT
+    || op == Operator::GT || op == Operator::LE || op == Operator::GE;
+  if (lk == ValueKind::STRING || rk == ValueKind::STRING) {
+    if (lk != rk || (op != Operator::EQ && op != Operator::NE)) {
+      error("Operator '" + std::string(operatorName(op)) + "' cannot take " + std::string(valueKindName(lk)) + " and " + std::string(valueKindName(rk)), node);
+    }
+  }
+
+  if (compare) {
+    return ValueKind::BOOL;
+  }
+  return lk == ValueKind::FLOAT || rk == ValueKind::FLOAT ? ValueKind::FLOAT : ValueKind::INT;
+}
+
+ValueKind Resolver::Walk::unary(NodeId id) {
+  const ASTNode &node = m_ast.node(id);
+  ValueKind kind = expr(node.unary.operand);
+  switch (node.unary.op) {
+  case Operator::SUB:
+  case Operator::ADD:
+    if (!isNumeric(kind)) {
+      error("Operator '" + std::string(operatorName(node.unary.op)) + "' cannot take " + std::string(valueKindName(kind)), node);
+    }
+    return kind == ValueKind::FLOAT ? ValueKind::FLOAT : ValueKind::INT;
+  case Operator::NOT:
+    return ValueKind::BOOL;
+  default:
+    error("Cannot compile operator '" + std::string(operatorName(node.unary.op)) + "'", node);
+  }
+}
+
+ValueKind Resolver::Walk::branch(NodeId id) {
+  const ASTNode &node = m_ast.node(id);
+  expr(node.if_.cond);
+  ValueKind tk = expr(node.if_.then);
+  // Without an else the value is zero, which is valid for every kind.
+  ValueKind ek = node.if_.else_ != NO_NODE ? expr(node.if_.else_) : tk;
+
+  if (tk == ek || (isIntegral(tk) && isIntegral(ek))) {
+    return tk == ek ? tk : ValueKind::INT;
+  }
+  if (!isNumeric(tk) || !isNumeric(ek)) {
+    error("Branches of 'if' are " + std::string(valueKindName(tk)) + " and " + std::string(valueKindName(ek)), node);
+  }
+  return ValueKind::FLOAT;
+}
+
+ValueKind Resolver::Walk::call(NodeId id) {
+  const ASTNode &node = m_ast.node(id);
+  NodeId func = node.call.func;
+  const ASTNode &callee = m_ast.node(func);
+  if (callee.type != ASTType::NAME) {
+    error("Only named functions can be called", callee);
+  }
+  auto args = m_ast.list(node.call.args);
+
+  uint32_t index = m_resolver.m_functionOf[callee.name.id];
+  if (index == NONE) {
+    if (callee.name != m_resolver.m_print) {
+      error("Unknown function '" + name(callee.name) + "'", callee);
+    }
+    for (NodeId arg : args) {
+      expr(arg);
+    }
+    bind(func, ValueKind::INT, 0, Semantics::PRINT);
+    m_out.m_slots[id] = Semantics::PRINT;
+    return ValueKind::INT;
+  }
+
+  const Semantics::Function &function = m_out.m_functions[index];
+  if (args.size() != function.params.size()) {
+    std::string message = "'" + name(function.name);
+    message += "' takes " + std::to_string(function.params.size()) + " arguments, not " + std::to_string(args.size());
+    error(message, node);
+  }
+  for (size_t i = 0; i < args.size(); i++) {
+    convert(expr(args[i]), function.params[i], m_ast.node(args[i]));
+  }
+  bind(func, function.result, 0, index);
+  m_out.m_slots[id] = index;
+  return function.result;
+}
+
+void Resolver::Walk::declare(NodeId id, ValueKind kind) {
+  Symbol symbol = m_ast.node(id).var.name;
+  uint32_t slot = m_slots++;
+  m_locals.push_back(Local{ symbol, slot, m_depth, kind, m_innermost[symbol.id] });
+  m_innermost[symbol.id] = static_cast<uint32_t>(m_locals.size() - 1);
+  bind(id, kind, m_depth, slot);
+}
+
+void Resolver::Walk::close(size_t mark) {
+  while (m_locals.size() > mark) {
+    m_innermost[m_locals.back().name.id] = m_locals.back().shadowed;
+    m_locals.pop_back();
+  }
+}
+
+const Resolver::Walk::Local *Resolver::Walk::find(Symbol name) const {
+  uint32_t index = m_innermost[name.id];
+  return index == NONE ? nullptr : &m_locals[index];
+}
+
+void Resolver::Walk::bind(NodeId id, ValueKind kind, uint16_t depth, uint32_t slot) {
+  m_out.m_kinds[id] = kind;
+  m_out.m_depths[id] = depth;
+  m_out.m_slots[id] = slot;
+}
+
+void Resolver::Walk::convert(ValueKind from, ValueKind to, const ASTNode &at) const {
+  if (from == to || (isIntegral(from) && isIntegral(to)) || (isIntegral(from) && to == ValueKind::FLOAT)) {
+    return;
+  }
+  error("Cannot convert " + std::string(valueKindName(from)) + " to " + std::string(valueKindName(to)), at);
+}
@@ -0,0 +1,374 @@
+#include "Server.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Resolver.h"
+#include "SourceMap.h"
+
+namespace {
+  constexpr std::string_view COMMAND_NAMES[Server::COMMANDS] = { "parse", "check" };
+
+  // A request line longer than this is no request; the connection is
+  // dropped rather than buffered without end.
+  constexpr size_t MAX_LINE = 64 * 1024;
+  // Nor is a LENGTH over this: the bytes would be buffered before the first
+  // of them had arrived.
+  constexpr uint64_t MAX_SOURCE = 256 << 20;
+
+  // Buffered reads and whole writes on a connected socket. Each returns
+  // false once the peer has gone.
+  class Connection {
+  private:
+    int m_fd;
+    std::string m_buffer;
+    size_t m_pos = 0; // start of what has not been read yet
+
+  public:
+    explicit Connection(int fd) : m_fd(fd) { }
+
+    // Reads up to the next '\n', which is dropped.
+    bool readLine(std::string &line) {
+      for (;;) {
+        size_t end = m_buffer.find('\n', m_pos);
+        if (end != std::string::npos) {
+          line.assign(m_buffer, m_pos, end - m_pos);
+          m_pos = end + 1;
+          return true;
+        }
+        if (m_buffer.size() - m_pos > MAX_LINE || !fill()) {
+          return false;
+        }
+      }
+    }
+
+    // Reads exactly `size` bytes into `out`, reusing its space.
+    bool read(std::string &out, size_t size) {
+      size_t buffered = std::min(size, m_buffer.size() - m_pos);
+      out.assign(m_buffer, m_pos, buffered);
+      m_pos += buffered;
+      out.resize(size);
+      for (size_t have = buffered; have < size;) {
+        ssize_t got = ::recv(m_fd, out.data() + have, size - have, 0);
+        if (got < 0 && errno == EINTR) {
+          continue;
+        }
+        if (got <= 0) {
+          return false;
+        }
+        have += got;
+      }
+      return true;
+    }
+
+    bool write(std::string_view data) {
+      while (!data.empty()) {
+        // MSG_NOSIGNAL: a client that hung up is no reason to die of SIGPIPE.
+        ssize_t sent = ::send(m_fd, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+          continue;
+        }
+        if (sent <= 0) {
+          return false;
+        }
+        data.remove_prefix(sent);
+      }
+      return true;
+    }
+
+  private:
+    bool fill() {
+      m_buffer.erase(0, m_pos);
+      m_pos = 0;
+      char chunk[4096];
+      for (;;) {
+        ssize_t got = ::recv(m_fd, chunk, sizeof(chunk), 0);
+        if (got < 0 && errno == EINTR) {
+          continue;
+        }
+        if (got <= 0) {
+          return false;
+        }
+        m_buffer.append(chunk, got);
+        return true;
+      }
+    }
+  };
+} // namespace
+
+void Latencies::add(uint64_t nanos) {
+  m_counts[bucketOf(nanos)]++;
+  m_samples++;
+  m_max = std::max(m_max, nanos);
+}
+
+uint64_t Latencies::percentile(double fraction) const {
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(fraction * m_samples)));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; i++) {
+    seen += m_counts[i];
+    if (seen < rank) {
+      continue;
+    }
+    if (i < SUB_BUCKETS) {
+      return std::min<uint64_t>(i, m_max);
+    }
+    // Bucket i holds [SUB_BUCKETS + i % SUB_BUCKETS, ... + 1) << shift; the
+    // top one's bound wraps to 0, making the top UINT64_MAX.
+    unsigned shift = i / SUB_BUCKETS - 1;
+    uint64_t top = ((SUB_BUCKETS + i % SUB_BUCKETS + uint64_t{ 1 }) << shift) - 1;
+    return std::min(top, m_max);
+  }
+  return m_max;
+}
+
+size_t Latencies::bucketOf(uint64_t nanos) {
+  if (nanos < SUB_BUCKETS) {
+    return nanos;
+  }
+  // The leading bit picks a row of SUB_BUCKETS, the SUB_BITS after it the
+  // bucket in the row.
+  unsigned power = 63 - __builtin_clzll(nanos);
+  return (power - SUB_BITS + 1) * SUB_BUCKETS + ((nanos >> (power - SUB_BITS)) & (SUB_BUCKETS - 1));
+}
+
+Server::Server(std::string path, const DriverOptions &options) : m_path(std::move(path)), m_options(options) {
+  if (!m_options.cacheDir.empty()) {
+    m_cache = std::make_unique<ASTCache>(m_options.cacheDir);
+  }
+
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (m_path.empty() || m_path.size() >= sizeof(address.sun_path)) {
+    throw std::runtime_error("Cannot listen on '" + m_path + "': not a usable socket path");
+  }
+  std::memcpy(address.sun_path, m_path.data(), m_path.size());
+  auto *generic = reinterpret_cast<const sockaddr *>(&address);
+
+  m_listener = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (m_listener < 0) {
+    throw std::runtime_error("Cannot create a socket: " + std::string(std::strerror(errno)));
+  }
+  // A socket nobody answers on was left by a server that did not shut down
+  // cleanly, and is replaced. A live one, or anything else at the path, is
+  // not touched, and fails the bind.
+  struct stat st;
+  if (::stat(m_path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+    int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0 && ::connect(probe, generic, sizeof(address)) < 0 && errno == ECONNREFUSED) {
+      ::unlink(m_path.c_str());
+    }
+    if (probe >= 0) {
+      ::close(probe);
+    }
+  }
+  if (::bind(m_listener, generic, sizeof(address)) < 0 || ::listen(m_listener, SOMAXCONN) < 0) {
+    int err = errno;
+    ::close(m_listener);
+    throw std::runtime_error("Cannot listen on '" + m_path + "': " + std::strerror(err));
+  }
+}
+
+Server::~Server() {
+  ::close(m_listener);
+  ::unlink(m_path.c_str());
+}
+
+void Server::operator()() {
+  int failure = 0;
+  for (;;) {
+    int fd = ::accept4(m_listener, nullptr, nullptr, SOCK_CLOEXEC);
+    int err = errno;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_stopping) {
+      if (fd >= 0) {
+        ::close(fd);
+      }
+      break;
+    }
+    if (fd < 0) {
+      if (err == EINTR || err == ECONNABORTED) {
+        continue;
+      }
+      failure = err;
+      break;
+    }
+    m_clients.push_back(fd);
+    std::thread(&Server::serve, this, fd).detach();
+  }
+
+  stop();
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_closed.wait(lock, [this] {
+    return m_clients.empty();
+  });
+  if (failure != 0) {
+    throw std::runtime_error("Cannot accept on '" + m_path + "': " + std::strerror(failure));
+  }
+}
+
+void Server::serve(int fd) {
+  try {
+    serveRequests(fd);
+  } catch (const std::exception &) {
+    // Out of memory, most likely: only this connection gives up.
+  }
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_clients.erase(std::find(m_clients.begin(), m_clients.end(), fd));
+  ::close(fd);
+  m_closed.notify_all();
+}
+
+void Server::serveRequests(int fd) {
+  Connection connection(fd);
+  std::string line;
+  std::ostringstream out;
+  for (bool open = true; open && connection.readLine(line);) {
+    auto arrival = std::chrono::steady_clock::now();
+    std::istringstream words(line);
+    std::string name, path, rest;
+    uint64_t length = 0;
+    words >> name >> path;
+    bool sent = static_cast<bool>(words >> length);
+    // Anything left over, a LENGTH that is no number included.
+    bool extra = sent ? static_cast<bool>(words >> rest) : !words.eof();
+    bool request = (name == "parse" || name == "check") && !path.empty() && !extra;
+
+    out.str("");
+    int status = 0;
+    bool shutdown = false;
+    bool drop = false;
+    if (name == "stats" && path.empty()) {
+      printStats(out);
+    } else if (name == "shutdown" && path.empty()) {
+      shutdown = true;
+    } else if (request && length > MAX_SOURCE) {
+      // Its bytes are left unread, so the connection cannot tell where the
+      // next request starts, and ends with the answer.
+      out << "LENGTH is more than " << MAX_SOURCE << " bytes\n";
+      status = 2;
+      drop = true;
+    } else if (request) {
+      std::unique_ptr<Workspace> workspace;
+      {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_idle.empty()) {
+          workspace = std::move(m_idle.back());
+          m_idle.pop_back();
+        }
+      }
+      if (!workspace) {
+        workspace = std::make_unique<Workspace>();
+      }
+
+      Command command = name == "parse" ? Command::PARSE : Command::CHECK;
+      uint64_t nanos = 0;
+      if (!sent || connection.read(workspace->text, length)) {
+        status = handle(command, path, *workspace, sent, out);
+        nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - arrival).count();
+      } else {
+        open = false;
+      }
+
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (open) {
+        m_latencies[static_cast<size_t>(command)].add(nanos);
+      }
+      m_idle.push_back(std::move(workspace));
+      if (!open) {
+        break;
+      }
+    } else {
+      out << "Expected parse PATH [LENGTH], check PATH [LENGTH], stats or shutdown\n";
+      status = 2;
+    }
+
+    std::string body = out.str();
+    open = connection.write(std::to_string(status) + ' ' + std::to_string(body.size()) + '\n' + body) && !drop;
+    if (shutdown) {
+      stop();
+    }
+  }
+}
+
+int Server::handle(Command command, std::string_view path, Workspace &workspace, bool sent, std::ostream &out) {
+  ParseResult &result = workspace.result;
+  result.clear();
+  result.path = path;
+  if (sent) {
+    result.source = Source(std::string_view(workspace.text));
+  } else {
+    try {
+      result.source = Source::mapFile(result.path);
+    } catch (const std::exception &e) {
+      result.error = e.what();
+    }
+  }
+  if (result.error.empty()) {
+    parseSource(result, m_options.mode, m_cache.get(), false, m_options.maxDepth);
+  }
+  if (!result.ok()) {
+    result.report(out);
+    return 1;
+  }
+  if (command == Command::PARSE) {
+    out << result.path << ": " << result.ast << '\n';
+    return 0;
+  }
+
+  try {
+    Resolver(result.ast, result.symbols)();
+  } catch (const SourceError &e) {
+    out << result.path << ": " << e.what() << " at " << SourceMap(result.source.view()).locate(e.offset()) << '\n';
+    return 1;
+  } catch (const std::exception &e) {
+    out << result.path << ": " << e.what() << '\n';
+    return 1;
+  }
+  out << result.path << ": ok\n";
+  return 0;
+}
+
+void Server::stop() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  if (m_stopping) {
+    return;
+  }
+  m_stopping = true;
+  // Wakes the accept() in operator(), and ends every connection at its next
+  // read: a request already read is still answered.
+  ::shutdown(m_listener, SHUT_RDWR);
+  for (int fd : m_clients) {
+    ::shutdown(fd, SHUT_RD);
+  }
+}
+
+void Server::printStats(std::ostream &os) const {
+  std::lock_guard<std::mutex> lock(m_mutex);
+  for (size_t c = 0; c < COMMANDS; c++) {
+    const Latencies &latencies = m_latencies[c];
+    os << COMMAND_NAMES[c] << ": " << latencies.samples() << " requests";
+    if (latencies.samples() != 0) {
+      os << std::fixed << std::setprecision(3);
+      os << ", p50 " << latencies.percentile(0.50) / 1e6 << " ms";
+      os << ", p90 " << latencies.percentile(0.90) / 1e6 << " ms";
+      os << ", p99 " << latencies.percentile(0.99) / 1e6 << " ms";
+      os << ", max " << latencies.max() / 1e6 << " ms";
+      os << std::defaultfloat;
+    }
+    os << '\n';
+  }
+}
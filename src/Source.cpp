@@ -0,0 +1,89 @@
+#include "Source.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Source::Source(std::string_view buffer) : m_data(buffer.data()), m_size(buffer.size()) { }
+
+Source::Source(std::basic_istream<char> &stream)
+  : m_owned(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>()) {
+  m_data = m_owned.data();
+  m_size = m_owned.size();
+}
+
+Source::~Source() {
+  release();
+}
+
+Source::Source(Source &&other) noexcept {
+  *this = std::move(other);
+}
+
+Source &Source::operator =(Source &&other) noexcept {
+  if (this == &other) {
+    return *this;
+  }
+  release();
+
+  bool owned = other.m_data != nullptr && other.m_data == other.m_owned.data();
+  m_owned = std::move(other.m_owned);
+  m_data = owned ? m_owned.data() : other.m_data;
+  m_size = other.m_size;
+  m_mapping = other.m_mapping;
+  m_mappingSize = other.m_mappingSize;
+
+  other.m_data = nullptr;
+  other.m_size = 0;
+  other.m_mapping = nullptr;
+  other.m_mappingSize = 0;
+  return *this;
+}
+
+Source Source::mapFile(const std::string &path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw std::runtime_error("Cannot open '" + path + "': " + std::strerror(errno));
+  }
+
+  struct stat st;
+  if (::fstat(fd, &st) < 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::runtime_error("Cannot stat '" + path + "': " + std::strerror(err));
+  }
+
+  Source source;
+  if (st.st_size > 0) {
+    void *mapping = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping == MAP_FAILED) {
+      int err = errno;
+      ::close(fd);
+      throw std::runtime_error("Cannot map '" + path + "': " + std::strerror(err));
+    }
+    ::madvise(mapping, st.st_size, MADV_SEQUENTIAL);
+    source.m_mapping = mapping;
+    source.m_mappingSize = st.st_size;
+    source.m_data = static_cast<const char *>(mapping);
+    source.m_size = st.st_size;
+  }
+  ::close(fd);
+
+  return source;
+}
+
+void Source::release() {
+  if (m_mapping != nullptr) {
+    ::munmap(m_mapping, m_mappingSize);
+    m_mapping = nullptr;
+    m_mappingSize = 0;
+  }
+  m_data = nullptr;
+  m_size = 0;
+}
@@ -0,0 +1,34 @@
+#include "SourceMap.h"
+
+#include <algorithm>
+
+#include "Chars.h"
+
+SourceMap::SourceMap(std::string_view text, uint32_t firstRow) : m_text(text), m_firstRow(firstRow) { }
+
+void SourceMap::index() const {
+  // Sources average a few dozen bytes a line, so reserving for that keeps
+  // the vector from regrowing while the newline scan runs ahead.
+  m_lines.reserve(m_text.size() / 32 + 1);
+  m_lines.push_back(0);
+  const char *begin = m_text.data(), *end = begin + m_text.size();
+  for (const char *p = scanLine(begin, end); p != end; p = scanLine(p + 1, end)) {
+    m_lines.push_back(static_cast<uint32_t>(p + 1 - begin));
+  }
+}
+
+SourcePosition SourceMap::position(uint32_t offset) const {
+  if (m_lines.empty()) {
+    index();
+  }
+  // The last line starting at or before the offset.
+  auto line = std::upper_bound(m_lines.begin(), m_lines.end(), offset) - 1;
+  return SourcePosition{ m_firstRow + static_cast<uint32_t>(line - m_lines.begin()), offset - *line };
+}
+
+std::string SourceMap::locate(uint32_t offset) const {
+  SourcePosition at = position(offset);
+  return std::to_string(at.row) + ":" + std::to_string(at.col);
+}
+
+SourceError::SourceError(const std::string &message, uint32_t offset) : std::runtime_error(message), m_offset(offset) { }
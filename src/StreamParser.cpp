@@ -0,0 +1,79 @@
+#include "StreamParser.h"
+
+#include <algorithm>
+
+// Tokens never span a newline except inside a literal, so the lexer is only
+// given whole lines. A statement still cut off at the end of them makes the
+// parse report an error at the end of its input, and recovery from an error
+// may run on to there too; either way the statement is parsed again once
+// another block has been read. Any other error is a real one, and reported.
+
+StreamParser::StreamParser(std::istream &stream, SymbolTable &symbols, size_t blockSize)
+  : m_stream(stream), m_symbols(symbols), m_blockSize(blockSize) { }
+
+void StreamParser::refill() {
+  m_window.erase(0, m_start);
+  m_lines -= m_start;
+  m_start = 0;
+
+  size_t size = m_window.size();
+  m_window.resize(size + m_blockSize);
+  m_stream.read(m_window.data() + size, m_blockSize);
+  m_window.resize(size + m_stream.gcount());
+
+  if (!m_stream) {
+    m_done = true;
+    m_lines = m_window.size();
+  } else if (auto newline = m_window.rfind('\n'); newline != std::string::npos && newline >= m_lines) {
+    m_lines = newline + 1;
+  }
+}
+
+size_t StreamParser::operator()(const Statement &statement, const Error &error) {
+  size_t count = 0;
+  refill();
+
+  while (true) {
+    Lexer lexer(std::string_view(m_window.data() + m_start, m_lines - m_start), m_symbols);
+    Parser parser(lexer);
+
+    size_t parsed = 0;
+    size_t reported = 0;
+    while (true) {
+      m_ast.clear();
+      uint32_t start = parser.currentToken().start();
+      NodeId form = parser.parseForm(m_ast);
+      uint32_t end = lexer.position();
+      if (form == NO_NODE) {
+        break;
+      }
+      auto &diagnostics = parser.diagnostics();
+      if (diagnostics.size() > reported) {
+        if (!m_done && parser.currentToken() == TokenType::EOB) {
+          break;
+        }
+        SourceMap source(lexer.source(), m_row);
+        for (; reported < diagnostics.size(); reported++) {
+          error(diagnostics[reported], source);
+        }
+        parsed = end;
+        continue;
+      }
+
+      parsed = end;
+      for (NodeId id = 0; id < m_ast.size(); id++) {
+        m_ast.node(id).offset -= start;
+      }
+      m_ast.setRoot(form);
+      statement(m_ast);
+      count++;
+    }
+
+    m_row += static_cast<uint32_t>(std::count(m_window.begin() + m_start, m_window.begin() + m_start + parsed, '\n'));
+    m_start += parsed;
+    if (m_done) {
+      return count;
+    }
+    refill();
+  }
+}
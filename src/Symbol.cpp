@@ -0,0 +1,58 @@
+#include "Symbol.h"
+
+#include <cstring>
+
+SymbolTable::SymbolTable() {
+  m_names.emplace_back();
+}
+
+Symbol SymbolTable::intern(std::string_view name) {
+  auto it = m_ids.find(name);
+  if (it != m_ids.end()) {
+    return Symbol{ it->second };
+  }
+
+  uint32_t id = static_cast<uint32_t>(m_names.size());
+  auto stored = store(name);
+  m_names.push_back(stored);
+  m_ids.emplace(stored, id);
+  return Symbol{ id };
+}
+
+Symbol SymbolTable::find(std::string_view name) const {
+  auto it = m_ids.find(name);
+  return it != m_ids.end() ? Symbol{ it->second } : Symbol{};
+}
+
+void SymbolTable::clear() {
+  m_ids.clear();
+  m_names.resize(1);
+  std::unique_ptr<char[]> current;
+  for (auto &chunk : m_chunks) {
+    if (chunk.get() == m_chunk) {
+      current = std::move(chunk);
+    }
+  }
+  m_chunks.clear();
+  if (current) {
+    m_chunks.push_back(std::move(current));
+  }
+  m_chunkUsed = 0;
+}
+
+std::string_view SymbolTable::store(std::string_view name) {
+  char *dst;
+  if (name.size() > CHUNK_SIZE / 4) {
+    // Long names get a block of their own; the current chunk keeps filling.
+    dst = m_chunks.emplace_back(new char[name.size()]).get();
+  } else {
+    if (m_chunk == nullptr || m_chunkUsed + name.size() > CHUNK_SIZE) {
+      m_chunk = m_chunks.emplace_back(new char[CHUNK_SIZE]).get();
+      m_chunkUsed = 0;
+    }
+    dst = m_chunk + m_chunkUsed;
+    m_chunkUsed += name.size();
+  }
+  std::memcpy(dst, name.data(), name.size());
+  return std::string_view(dst, name.size());
+}
@@ -0,0 +1,96 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(unsigned threads) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    m_queues.push_back(std::make_unique<Queue>());
+  }
+  for (unsigned i = 0; i < threads; i++) {
+    m_workers.emplace_back(&ThreadPool::run, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard lock(m_mutex);
+    m_stopping = true;
+  }
+  m_wake.notify_all();
+  for (auto &worker : m_workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(Task task) {
+  auto &queue = *m_queues[m_next++ % m_queues.size()];
+  {
+    std::lock_guard lock(queue.mutex);
+    queue.tasks.push_back(std::move(task));
+  }
+  {
+    std::lock_guard lock(m_mutex);
+    m_pending++;
+  }
+  m_wake.notify_one();
+}
+
+void ThreadPool::wait() {
+  std::unique_lock lock(m_mutex);
+  m_idle.wait(lock, [this]() { return m_pending == 0; });
+}
+
+bool ThreadPool::take(unsigned worker, Task &task) {
+  {
+    auto &own = *m_queues[worker];
+    std::lock_guard lock(own.mutex);
+    if (!own.tasks.empty()) {
+      task = std::move(own.tasks.front());
+      own.tasks.pop_front();
+      return true;
+    }
+  }
+  for (size_t i = 1; i < m_queues.size(); i++) {
+    auto &victim = *m_queues[(worker + i) % m_queues.size()];
+    std::lock_guard lock(victim.mutex);
+    if (!victim.tasks.empty()) {
+      task = std::move(victim.tasks.back());
+      victim.tasks.pop_back();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::run(unsigned worker) {
+  Task task;
+  while (true) {
+    if (take(worker, task)) {
+      task(worker);
+      task = nullptr;
+
+      std::lock_guard lock(m_mutex);
+      if (--m_pending == 0) {
+        m_idle.notify_all();
+      }
+      continue;
+    }
+
+    std::unique_lock lock(m_mutex);
+    if (m_stopping) {
+      return;
+    }
+    // Tasks not yet claimed by anyone: go back and look for them.
+    size_t queued = 0;
+    for (auto &queue : m_queues) {
+      std::lock_guard queueLock(queue->mutex);
+      queued += queue->tasks.size();
+    }
+    if (queued == 0) {
+      m_wake.wait(lock);
+    }
+  }
+}
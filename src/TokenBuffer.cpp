@@ -0,0 +1,76 @@
+#include "TokenBuffer.h"
+
+#include "Allocs.h"
+
+void TokenBuffer::attach(const Lexer &lexer) {
+  m_lexer = &lexer;
+}
+
+void TokenBuffer::push(const Token &tok) {
+  m_types.push_back(tok.type);
+  m_ids.push_back(tok.id);
+  m_offsets.push_back(tok.offset);
+  m_lengths.push_back(static_cast<uint32_t>(tok.value.size()));
+}
+
+void TokenBuffer::reserve(size_t count) {
+  m_types.reserve(count);
+  m_ids.reserve(count);
+  m_offsets.reserve(count);
+  m_lengths.reserve(count);
+}
+
+void TokenBuffer::clear() {
+  m_types.clear();
+  m_ids.clear();
+  m_offsets.clear();
+  m_lengths.clear();
+}
+
+void TokenBuffer::erase(size_t count) {
+  m_types.erase(m_types.begin(), m_types.begin() + count);
+  m_ids.erase(m_ids.begin(), m_ids.begin() + count);
+  m_offsets.erase(m_offsets.begin(), m_offsets.begin() + count);
+  m_lengths.erase(m_lengths.begin(), m_lengths.begin() + count);
+}
+
+std::string_view TokenBuffer::value(size_t i) const {
+  bool literal = m_types[i] == TokenType::STRING || m_types[i] == TokenType::CHAR;
+  if (literal && m_ids[i] != 0 && m_ids[i] != literal::UNTERMINATED) {
+    return m_lexer->cooked(m_ids[i]);
+  }
+  return m_lexer->text(m_offsets[i], m_lengths[i]);
+}
+
+Token TokenBuffer::token(size_t i) const {
+  return Token{ m_types[i], value(i), m_ids[i], m_offsets[i] };
+}
+
+TokenCursor::TokenCursor(Lexer &lexer, TokenMode mode) : m_lexer(lexer), m_mode(mode) {
+  ALLOC_SITE(LEXER);
+  m_tokens.attach(lexer);
+  if (m_mode == TokenMode::PRELEXED) {
+    m_lexer.tokenize(m_tokens);
+  } else if (m_mode == TokenMode::CHUNKED) {
+    m_lexer.tokenizeChunked(m_tokens);
+  }
+}
+
+void TokenCursor::fill(size_t i) {
+  ALLOC_SITE(LEXER);
+  while (m_tokens.size() <= i) {
+    if (m_tokens.size() != 0 && m_tokens.type(m_tokens.size() - 1) == TokenType::EOB) {
+      return;
+    }
+    m_tokens.push(m_lexer.nextToken());
+  }
+}
+
+void TokenCursor::release() {
+  // Only worth the move once the consumed prefix dominates the buffer.
+  if (m_mode == TokenMode::ON_DEMAND && m_pos >= 64 && m_pos * 2 >= m_tokens.size()) {
+    m_tokens.erase(m_pos);
+    m_released += m_pos;
+    m_pos = 0;
+  }
+}
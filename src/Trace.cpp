@@ -0,0 +1,80 @@
+#include "Trace.h"
+
+#if SKWIRL_TRACE
+
+#include <chrono>
+#include <string_view>
+
+namespace trace {
+  namespace {
+    Record RING[CAPACITY];
+    std::atomic<uint64_t> NEXT = 0;
+    std::atomic<uint16_t> THREADS = 0;
+
+    thread_local uint16_t THREAD = THREADS.fetch_add(1, std::memory_order_relaxed);
+
+    std::string_view eventName(Event event) {
+      switch (event) {
+      case Event::STATEMENT: return "STATEMENT";
+      case Event::GROUP: return "GROUP";
+      case Event::PUNCTUATOR: return "PUNCTUATOR";
+      case Event::NODE: return "NODE";
+      case Event::OPERATOR: return "OPERATOR";
+      case Event::FUNCTION: return "FUNCTION";
+      }
+      return "?";
+    }
+  } // namespace
+
+  void record(Event event, uint32_t token, uint32_t node, char arg) {
+    uint64_t index = NEXT.fetch_add(1, std::memory_order_relaxed);
+    Record &slot = RING[index & (CAPACITY - 1)];
+    slot.seq.store(0, std::memory_order_relaxed);
+    slot.time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+    slot.token = token;
+    slot.node = node;
+    slot.thread = THREAD;
+    slot.event = event;
+    slot.arg = arg;
+    slot.seq.store(index + 1, std::memory_order_release);
+  }
+
+  void dump(std::ostream &os) {
+    uint64_t end = NEXT.load(std::memory_order_acquire);
+    uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+    uint64_t start = 0;
+    for (uint64_t i = begin; i < end; i++) {
+      const Record &slot = RING[i & (CAPACITY - 1)];
+      // Skip slots still being written or already taken by a newer event.
+      if (slot.seq.load(std::memory_order_acquire) != i + 1) {
+        continue;
+      }
+      if (start == 0) {
+        start = slot.time;
+      }
+      os << '+' << slot.time - start << " t" << slot.thread << ' ' << eventName(slot.event)
+         << " tok=" << slot.token << " node=";
+      if (slot.node == UINT32_MAX) {
+        os << '-';
+      } else {
+        os << slot.node;
+      }
+      if (slot.arg == '\n') {
+        os << " \\n";
+      } else if (slot.arg != 0) {
+        os << ' ' << slot.arg;
+      }
+      os << '\n';
+    }
+  }
+
+  void clear() {
+    for (auto &slot : RING) {
+      slot.seq.store(0, std::memory_order_relaxed);
+    }
+    NEXT.store(0, std::memory_order_release);
+  }
+} // namespace trace
+
+#endif
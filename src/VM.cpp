@@ -0,0 +1,189 @@
+#include "VM.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+#include "SourceMap.h"
+
+#ifndef SKWIRL_COMPUTED_GOTO
+#if defined(__GNUC__)
+#define SKWIRL_COMPUTED_GOTO 1
+#else
+#define SKWIRL_COMPUTED_GOTO 0
+#endif
+#endif
+
+VM::VM(const Program &program, std::ostream &out)
+  : m_program(program), m_out(out), m_stack(STACK_SLOTS), m_globals(program.globals) {
+  m_frames.reserve(64);
+}
+
+void VM::error(const std::string &message, const Function &function, const Instr *pc) const {
+  size_t i = pc - 1 - function.code.data();
+  throw SourceError(message, function.offsets[i]);
+}
+
+// Labels as values and computed goto are GNU extensions.
+#if SKWIRL_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+Slot VM::run() {
+  const Function *fn = &m_program.functions[m_program.main];
+  Slot *base = m_stack.data();
+  Slot *const stackEnd = m_stack.data() + m_stack.size();
+  Slot *const globals = m_globals.data();
+  const Slot *const constants = m_program.constants.data();
+  const Instr *pc = fn->code.data();
+  Instr ins;
+  m_frames.clear();
+  std::fill(m_globals.begin(), m_globals.end(), Slot{});
+  if (fn->registers > m_stack.size()) {
+    throw std::runtime_error("Stack overflow");
+  }
+
+  #define R(r) base[r]
+
+#if SKWIRL_COMPUTED_GOTO
+  static const void *const LABELS[] = {
+    #define SKWIRL_OPCODE_LABEL(name) &&op_##name,
+    SKWIRL_OPCODES(SKWIRL_OPCODE_LABEL)
+    #undef SKWIRL_OPCODE_LABEL
+  };
+  #define VM_CASE(name) op_##name:
+  #define VM_NEXT() do { ins = *pc++; goto *LABELS[static_cast<size_t>(ins.op)]; } while (0)
+
+  VM_NEXT();
+#else
+  #define VM_CASE(name) case OpCode::name:
+  #define VM_NEXT() continue
+
+  while (true) {
+    ins = *pc++;
+    switch (ins.op) {
+#endif
+
+  VM_CASE(MOVE) R(ins.a) = R(ins.b); VM_NEXT();
+  VM_CASE(LOADI) R(ins.a).i = ins.sbx(); VM_NEXT();
+  VM_CASE(LOADK) R(ins.a) = constants[ins.bx()]; VM_NEXT();
+  VM_CASE(LOADG) R(ins.a) = globals[ins.bx()]; VM_NEXT();
+  VM_CASE(STOREG) globals[ins.bx()] = R(ins.a); VM_NEXT();
+
+  // Integer arithmetic wraps rather than overflowing into undefined
+  // behaviour.
+  VM_CASE(ADDI) R(ins.a).i = static_cast<int64_t>(static_cast<uint64_t>(R(ins.b).i) + static_cast<uint64_t>(R(ins.c).i)); VM_NEXT();
+  VM_CASE(SUBI) R(ins.a).i = static_cast<int64_t>(static_cast<uint64_t>(R(ins.b).i) - static_cast<uint64_t>(R(ins.c).i)); VM_NEXT();
+  VM_CASE(MULI) R(ins.a).i = static_cast<int64_t>(static_cast<uint64_t>(R(ins.b).i) * static_cast<uint64_t>(R(ins.c).i)); VM_NEXT();
+  VM_CASE(DIVI) {
+    int64_t d = R(ins.c).i;
+    if (d == 0) {
+      error("Division by zero", *fn, pc);
+    }
+    int64_t n = R(ins.b).i;
+    R(ins.a).i = d == -1 ? static_cast<int64_t>(0 - static_cast<uint64_t>(n)) : n / d;
+    VM_NEXT();
+  }
+  VM_CASE(MODI) {
+    int64_t d = R(ins.c).i;
+    if (d == 0) {
+      error("Division by zero", *fn, pc);
+    }
+    R(ins.a).i = d == -1 ? 0 : R(ins.b).i % d;
+    VM_NEXT();
+  }
+
+  VM_CASE(ADDF) R(ins.a).f = R(ins.b).f + R(ins.c).f; VM_NEXT();
+  VM_CASE(SUBF) R(ins.a).f = R(ins.b).f - R(ins.c).f; VM_NEXT();
+  VM_CASE(MULF) R(ins.a).f = R(ins.b).f * R(ins.c).f; VM_NEXT();
+  VM_CASE(DIVF) R(ins.a).f = R(ins.b).f / R(ins.c).f; VM_NEXT();
+  VM_CASE(MODF) R(ins.a).f = std::fmod(R(ins.b).f, R(ins.c).f); VM_NEXT();
+
+  VM_CASE(NEGI) R(ins.a).i = static_cast<int64_t>(0 - static_cast<uint64_t>(R(ins.b).i)); VM_NEXT();
+  VM_CASE(NEGF) R(ins.a).f = -R(ins.b).f; VM_NEXT();
+  VM_CASE(NOT) R(ins.a).i = R(ins.b).i == 0; VM_NEXT();
+  VM_CASE(TESTI) R(ins.a).i = R(ins.b).i != 0; VM_NEXT();
+  VM_CASE(TESTF) R(ins.a).i = R(ins.b).f != 0.0; VM_NEXT();
+  VM_CASE(I2F) R(ins.a).f = static_cast<double>(R(ins.b).i); VM_NEXT();
+
+  VM_CASE(EQI) R(ins.a).i = R(ins.b).i == R(ins.c).i; VM_NEXT();
+  VM_CASE(NEI) R(ins.a).i = R(ins.b).i != R(ins.c).i; VM_NEXT();
+  VM_CASE(LTI) R(ins.a).i = R(ins.b).i < R(ins.c).i; VM_NEXT();
+  VM_CASE(LEI) R(ins.a).i = R(ins.b).i <= R(ins.c).i; VM_NEXT();
+  VM_CASE(EQF) R(ins.a).i = R(ins.b).f == R(ins.c).f; VM_NEXT();
+  VM_CASE(NEF) R(ins.a).i = R(ins.b).f != R(ins.c).f; VM_NEXT();
+  VM_CASE(LTF) R(ins.a).i = R(ins.b).f < R(ins.c).f; VM_NEXT();
+  VM_CASE(LEF) R(ins.a).i = R(ins.b).f <= R(ins.c).f; VM_NEXT();
+
+  VM_CASE(JMP) pc += ins.sbx(); VM_NEXT();
+  VM_CASE(JMPF) if (R(ins.a).i == 0) { pc += ins.sbx(); } VM_NEXT();
+  VM_CASE(JMPT) if (R(ins.a).i != 0) { pc += ins.sbx(); } VM_NEXT();
+
+  VM_CASE(CALL) {
+    const Function &callee = m_program.functions[ins.bx()];
+    Slot *calleeBase = base + ins.a;
+    if (static_cast<size_t>(stackEnd - calleeBase) < callee.registers || m_frames.size() >= MAX_FRAMES) {
+      error("Stack overflow calling '" + callee.name + "'", *fn, pc);
+    }
+    m_frames.push_back(Frame{ fn, pc, base });
+    fn = &callee;
+    base = calleeBase;
+    pc = callee.code.data();
+    VM_NEXT();
+  }
+  VM_CASE(RET) {
+    Slot result = R(ins.a);
+    if (m_frames.empty()) {
+      return result;
+    }
+    // The callee's first register is the caller's call register.
+    base[0] = result;
+    const Frame &frame = m_frames.back();
+    fn = frame.function;
+    pc = frame.ret;
+    base = frame.base;
+    m_frames.pop_back();
+    VM_NEXT();
+  }
+
+  VM_CASE(PRINT) {
+    printValue(m_out, m_program, R(ins.a), static_cast<ValueKind>(ins.b));
+    m_out << (ins.c ? '\n' : ' ');
+    VM_NEXT();
+  }
+
+#if !SKWIRL_COMPUTED_GOTO
+    }
+  }
+#endif
+
+  #undef VM_CASE
+  #undef VM_NEXT
+  #undef R
+}
+
+#if SKWIRL_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+void printValue(std::ostream &os, const Program &program, Slot value, ValueKind kind) {
+  switch (kind) {
+  case ValueKind::INT:
+    os << value.i;
+    break;
+  case ValueKind::FLOAT:
+    os << value.f;
+    break;
+  case ValueKind::BOOL:
+    os << (value.i != 0 ? "true" : "false");
+    break;
+  case ValueKind::CHAR:
+    os << static_cast<char>(value.i);
+    break;
+  case ValueKind::STRING:
+    os << program.strings[value.i];
+    break;
+  }
+}